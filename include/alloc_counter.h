@@ -0,0 +1,12 @@
+#pragma once
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <stdint.h>
+
+// counting replacement of the global operator new, in alloc_counter.cpp.
+// the build links it into profiled cores and into core_test only, nothing
+// else pays for it
+uint64_t CountedAllocations();
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+#ifndef BENCH_SCENES_H
+#define BENCH_SCENES_H
+
+#include <stdint.h>
+#include "particle_world.h"
+
+// the scenes bench measures, shared with the tests so both step the
+// same worlds
+enum SCENE {
+	SCENE_SAND_PILE,
+	SCENE_WATER_LAVA,
+	SCENE_SETTLED,
+	SCENE_CHURN,
+	SCENE_RAIN,
+	SCENE_COUNT,
+};
+
+extern const char* sceneNames[SCENE_COUNT];
+
+// the materials every scene uses; heat > 0 also turns on the heat field
+// at that resolution, with lava boiling water into steam
+void RegisterScenePalette(ParticleWorld& world, int heat);
+// fills an empty world with the scene, call after RegisterScenePalette()
+void BuildScene(ParticleWorld& world, int scene, uint64_t seed);
+
+#endif
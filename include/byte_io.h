@@ -0,0 +1,83 @@
+#pragma once
+#ifndef BYTE_IO_H
+#define BYTE_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// raw field encoding shared by the snapshot and replay formats: fields
+// are native (little) endian, strings are a uint32 length and the bytes,
+// floats are raw.
+
+inline void PutBytes(std::vector<uint8_t>& out, const void* src, size_t n)
+{
+	out.insert(out.end(), (const uint8_t*)src, (const uint8_t*)src + n);
+}
+
+inline void PutU32(std::vector<uint8_t>& out, uint32_t v)
+{
+	PutBytes(out, &v, 4);
+}
+
+inline void PutU64(std::vector<uint8_t>& out, uint64_t v)
+{
+	PutBytes(out, &v, 8);
+}
+
+inline void PutF32(std::vector<uint8_t>& out, float v)
+{
+	PutBytes(out, &v, 4);
+}
+
+inline void PutStr(std::vector<uint8_t>& out, const std::string& s)
+{
+	PutU32(out, (uint32_t)s.size());
+	PutBytes(out, s.data(), s.size());
+}
+
+// bounds-checked reads over [p, end). the first read past the end clears
+// ok, and from then on every read returns zeros, so a caller can read a
+// whole record and check ok once
+struct ByteReader {
+	const uint8_t* p;
+	const uint8_t* end;
+	bool ok = true;
+
+	void Read(void* dst, size_t n) {
+		if(!ok || (size_t)(end - p) < n){
+			ok = false;
+			memset(dst, 0, n);
+			return;
+		}
+		memcpy(dst, p, n);
+		p += n;
+	}
+	uint8_t U8() { uint8_t v; Read(&v, 1); return v; }
+	uint32_t U32() { uint32_t v; Read(&v, 4); return v; }
+	uint64_t U64() { uint64_t v; Read(&v, 8); return v; }
+	float F32() { float v; Read(&v, 4); return v; }
+	std::string Str() {
+		uint32_t n = U32();
+		if(!ok || (size_t)(end - p) < n){
+			ok = false;
+			return "";
+		}
+		std::string s((const char*)p, n);
+		p += n;
+		return s;
+	}
+	const uint8_t* Bytes(size_t n) {
+		if(!ok || (size_t)(end - p) < n){
+			ok = false;
+			return nullptr;
+		}
+		const uint8_t* b = p;
+		p += n;
+		return b;
+	}
+};
+
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+#ifndef CHUNK_CODEC_H
+#define CHUNK_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "particle_world.h"
+
+// run-length coding of one rectangle of the ID plane, row-major.
+// every run is 3 bytes: the ParticleID, then the run length as a
+// little-endian uint16, so a fully uniform CHUNK_SIZE tile is 3 bytes.
+
+void EncodeCellsRLE(const Cell* grid, size_t gridWidth, const CellRect& rect, std::vector<uint8_t>& out);
+// false if the runs do not exactly cover rect
+bool DecodeCellsRLE(const uint8_t* data, size_t size, Cell* grid, size_t gridWidth, const CellRect& rect);
+
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef CHUNK_STREAMER_H
+#define CHUNK_STREAMER_H
+
+#include <string>
+#include <raylib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "particle_world.h"
+#include "pool.h"
+
+// turns a ParticleWorld into a window onto an unbounded world of chunks.
+// chunks scrolled out of the window are kept as runs (see chunk_codec.h)
+// keyed by world chunk, empty ones are not kept at all, and past
+// cacheLimit the ones that left the window longest ago are paged out to
+// pageDirectory and read back when the window reaches them again.
+// only the window is simulated: its edges act as walls and stored chunks
+// stay frozen until they are resident again.
+// chunk records come from a Pool, so a chunk that scrolls out reuses the
+// run buffer of one that scrolled back in.
+class ChunkStreamer {
+private:
+	struct StoredChunk {
+		std::vector<uint8_t> runs;
+		uint64_t leftWindow = 0;
+		bool paged = false;
+	};
+
+	ParticleWorld& world;
+	std::string pageDirectory;
+	size_t cacheLimit;
+	bool usable;
+	uint64_t tick;
+	Pool<StoredChunk> chunks;
+	std::unordered_map<uint64_t, PoolHandle> stored;
+	std::vector<std::pair<uint64_t, uint64_t>> pageOrder;
+	std::vector<uint8_t> scratch;
+
+	static uint64_t Key(int32_t cx, int32_t cy);
+	std::string PagePath(uint64_t key) const;
+	void StoreChunk(size_t cx, size_t cy);
+	void LoadChunk(size_t cx, size_t cy);
+	void PageOut();
+public:
+	// the world must be a whole number of chunks wide and high
+	ChunkStreamer(ParticleWorld& world, std::string pageDirectory, size_t cacheLimit);
+	~ChunkStreamer();
+
+	// moves the window so the chunk under focus (in world cells) is at its
+	// centre; false if the world cannot be streamed
+	bool Follow(Vector2 focus);
+	bool MoveTo(int32_t originChunkX, int32_t originChunkY);
+
+	size_t StoredChunkCount() const;
+	size_t PagedChunkCount() const;
+};
+
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+#ifndef FALL_KERNEL_H
+#define FALL_KERNEL_H
+
+#include <stdint.h>
+#include "particle_world.h"
+
+// bit i of the result is set when cur[i] holds a particle and below[i] is
+// empty, for i in [0, n) with n <= 64. Picks AVX2 or SSE2 at runtime and
+// falls back to plain C++ elsewhere.
+uint64_t FallCandidates(const Cell* cur, const Cell* below, int n);
+
+// name of the variant FallCandidates dispatches to
+const char* FallKernelName();
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+#ifndef MOVE_RULES_H
+#define MOVE_RULES_H
+
+#include "particle_world.h"
+
+// neighbour offsets each PARTICLE_TYPE tries in order, resolved at compile
+// time by ParticleWorld::StepCell<T>. For every step:
+//   empty target      -> move there (gated steps only with p = density)
+//   reaction          -> target becomes the result, the mover disappears
+//   FLUID/GAS target  -> swap with p = density difference, else next step
+// STATIC and NONE have no rules and never initiate anything.
+
+struct MoveStep {
+	int dx, dy;
+	bool gated;
+};
+
+template<PARTICLE_TYPE T> struct MoveRules;
+
+template<> struct MoveRules<SOLID> {
+	static constexpr bool mirror = false;
+	static constexpr MoveStep steps[] = { {0, 1, false}, {1, 1, true}, {-1, 1, true} };
+};
+
+template<> struct MoveRules<FLUID> {
+	static constexpr bool mirror = false;
+	static constexpr MoveStep steps[] = { {0, 1, false}, {1, 0, false}, {-1, 0, false} };
+};
+
+// gas rises, and flips left/right at random so it does not drift sideways
+template<> struct MoveRules<GAS> {
+	static constexpr bool mirror = true;
+	static constexpr MoveStep steps[] = { {0, -1, false}, {1, -1, false}, {-1, -1, false}, {1, 0, false}, {-1, 0, false} };
+};
+
+// first step is an unconditional drop straight down, which the KERNEL_SIMD
+// fall pass applies in bulk. it does so before the rest of the row runs its
+// rules, so neighbours see those cells already emptied and the simulation
+// takes a different (still deterministic) course than KERNEL_SCALAR
+template<PARTICLE_TYPE T>
+constexpr bool FallsStraight() {
+	return MoveRules<T>::steps[0].dx == 0 && MoveRules<T>::steps[0].dy == 1 && !MoveRules<T>::steps[0].gated;
+}
+
+#endif
@@ -6,55 +6,66 @@
 #include <raylib.h>
 #include <stddef.h>
 #include <unordered_map>
+#include <vector>
+#include "particle_world.h"
 
-// helper
-struct PairHash {
-    std::size_t operator()(const std::pair<std::string, std::string>& p) const {
-        return std::hash<std::string>()(p.first) ^
-               (std::hash<std::string>()(p.second) << 1);
-    }
+enum RENDER_MODE {
+	RENDER_PER_TYPE, // one buffer, texture and draw per type, any shader per type
+	RENDER_PACKED,   // one ID texture, colours and materials resolved in one pass
 };
 
-std::pair<std::string, std::string> make_key(const std::string& a, const std::string& b);
-
-enum PARTICLE_TYPE {
-	NONE,
-	STATIC,
-	SOLID,
-	FLUID,
-	GAS,
-};
-
-struct Particle {
-	std::string parent;
-    PARTICLE_TYPE type = NONE;
-	Color clr;
-    float density;
+// effects the packed renderer can apply per type, see material.fs
+enum PARTICLE_MATERIAL {
+	MATERIAL_PLAIN,
+	MATERIAL_NOISE,
+	MATERIAL_HUE_SHIFT,
 };
-Particle* GenSolidParticle(std::string name, Color clr, float density);
-Particle* GenFluidParticle(std::string name, Color clr, float density);
-Particle* GenParticle(std::string name, PARTICLE_TYPE type, Color clr, float density);
 
-class ParticleSystem {
+// raylib renderer on top of the simulation core, needs a window. it owns
+// every texture and shader it loads and unloads them when destroyed, which
+// has to happen before CloseWindow()
+class ParticleSystem : public ParticleWorld {
 private:
-    Particle** particles;
-    size_t width, height;
 	Vector2 particleScale;
+	// world cell at the top-left of the screen
+	Vector2 camera;
 	Texture background;
 
-    std::unordered_map<std::string, Particle*> particleTypes;    
-    std::unordered_map<std::string, Color*> particleBuffers;     
-    std::unordered_map<std::string, Texture2D> particleTextures; 
+	RENDER_MODE renderMode;
+	// RENDER_PER_TYPE, indexed by ParticleID
+	std::vector<std::vector<Color>> particleBuffers;
+	std::vector<Texture2D> particleTextures;
 	std::unordered_map<std::string, Shader> particleShaders;
-	std::unordered_map<std::pair<std::string, std::string>, std::string, PairHash> particleInteractions;
+	// RENDER_PACKED
+	Texture2D idTexture;
+	Texture2D paletteTexture;
+	Shader materialShader;
+	std::unordered_map<std::string, PARTICLE_MATERIAL> particleMaterials;
+	std::vector<Color> palette;
+
+	// pipelined, the renderer reads its own copy of the grid, refreshed by
+	// PublishFrame() while Update() is not running
+	bool pipelined;
+	std::vector<Cell> renderCells;
+	std::vector<CellRect> publishedRects;
+	std::vector<CellRect> uploadRects;
+	std::vector<Color> uploadScratch;
+
+	const Cell* RenderCells() const;
+	void CollectDirty(std::vector<CellRect>& out);
+	void RefreshAll();
+	void SyncRenderResources();
+	void UnloadRenderResources();
+	void DrawGrid();
 public:
     ParticleSystem(Rectangle screen, Vector2 scale);
+	// a grid of its own size, e.g. a streamed window larger than the screen
+	ParticleSystem(size_t width, size_t height, Vector2 scale);
 	~ParticleSystem();
 
-    void RegisterParticle(Particle* prototype);
-    void InsertParticle(std::string typeName, Vector2 pos);
-	void SetParticleInteraction(std::string particleOne, std::string particleTwo, std::string particleResult);
 	void AddShaderToParticle(std::string typeName, std::string shaderFilePath);
+	void SetParticleMaterial(std::string typeName, PARTICLE_MATERIAL material);
+	void UsePackedRenderer(std::string materialShaderPath);
 	void SetBackground(Image img);
 
 	//shader stuff
@@ -64,10 +75,20 @@ public:
 	void UpdateShaderV3(std::string shaderPath, std::string uniformName, Vector3 value);
 	void UpdateShaderV4(std::string shaderPath, std::string uniformName, Vector4 value);
 
-    void Update();
     void UpdateColors();
     void UpdateTextures();
     void Render();
+	// when on, UpdateColors/UpdateTextures/Render only touch the copy made by
+	// the last PublishFrame(), so they can run while another thread is in
+	// Update(), see step_thread.h. PublishFrame() itself needs the world idle
+	void SetPipelined(bool pipelined);
+	void PublishFrame();
+	// timings and counters of the last profiled frame, see profiler.h
+	void DrawProfilerOverlay(int x, int y);
+	void SetCamera(Vector2 camera);
+	Vector2 GetCamera() const;
+	// grid coordinates under a screen position, taking the camera and the
+	// window origin into account
 	Vector2 ScreenToCanvas(Vector2 mousePos);
 };
 
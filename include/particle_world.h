@@ -0,0 +1,333 @@
+#pragma once
+#ifndef PARTICLE_WORLD_H
+#define PARTICLE_WORLD_H
+
+// simulation core: grid, registry, reactions and Update(), no rendering.
+// raylib.h is only used for its plain Color/Vector2 types, nothing here
+// calls into raylib or needs a window.
+#include <string>
+#include <raylib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "profiler.h"
+#include "rng.h"
+#include "worker_pool.h"
+
+enum PARTICLE_TYPE {
+	NONE,
+	STATIC,
+	SOLID,
+	FLUID,
+	GAS,
+};
+
+struct Particle {
+	std::string parent;
+    PARTICLE_TYPE type = NONE;
+	Color clr;
+    float density;
+};
+Particle GenSolidParticle(std::string name, Color clr, float density);
+Particle GenFluidParticle(std::string name, Color clr, float density);
+Particle GenParticle(std::string name, PARTICLE_TYPE type, Color clr, float density);
+const char* ParticleTypeName(PARTICLE_TYPE type);
+
+enum UPDATE_KERNEL {
+	KERNEL_SCALAR, // every particle goes through its move rules
+	// a vector pass drops free-falling rows first, see fall_kernel.h. not
+	// equivalent to KERNEL_SCALAR: for the same seed it is deterministic but
+	// follows its own trajectory
+	KERNEL_SIMD,
+};
+
+// seed of a new world, so two runs start out identical unless SetSeed() says otherwise
+#define DEFAULT_SEED 0x5EED5EED5EED5EEDull
+
+// index into the particle registry, 0 is always the empty cell
+typedef uint8_t ParticleID;
+#define EMPTY_PARTICLE ((ParticleID)0)
+#define MAX_PARTICLE_TYPES 256
+
+// Update() works on CHUNK_SIZE x CHUNK_SIZE tiles in a 4-phase checkerboard,
+// tiles of the same phase never touch each other's neighbourhoods
+#define CHUNK_SIZE 64
+static_assert((CHUNK_SIZE & (CHUNK_SIZE - 1)) == 0, "CHUNK_SIZE must be a power of two");
+static_assert(CHUNK_SIZE <= 256, "UpdateRegion keeps its column order in bytes");
+
+struct Cell {
+	ParticleID id = EMPTY_PARTICLE;
+};
+// the packed renderer uploads the grid as-is
+static_assert(sizeof(Cell) == 1, "Cell must stay one byte");
+
+// half-open cell rectangle [x0, x1) x [y0, y1)
+struct CellRect {
+	int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+
+	bool Empty() const { return x0 >= x1 || y0 >= y1; }
+	void Add(int x, int y);
+	void Merge(const CellRect& other);
+	CellRect Intersect(const CellRect& other) const;
+};
+
+struct Chunk {
+	// awake chunks are simulated by the next Update()
+	bool awake = true;
+	bool running = false;
+	// written only by the job updating this chunk, merged after its phase
+	bool restless = false;
+	CellRect changed;
+	// cells the renderer has not picked up yet
+	CellRect dirty;
+	// the last heat pass found nothing heat acts on and no cell changed
+	// since, so the next pass can skip it
+	bool heatIdle = false;
+	// profiled builds only, merged into the Profiler after the phase
+	PROFILE_ONLY(uint64_t visited = 0; uint64_t swaps = 0; uint64_t reactions = 0;)
+};
+
+// one side of an interaction matches either a particle name or,
+// when type != NONE, every particle of that PARTICLE_TYPE
+struct InteractionRule {
+	PARTICLE_TYPE typeOne = NONE;
+	std::string particleOne;
+	PARTICLE_TYPE typeTwo = NONE;
+	std::string particleTwo;
+	std::string result;
+};
+
+// optional temperature field, a float plane of its own next to the grid,
+// stepped every interval Update() calls. see heat.cpp
+struct HeatSettings {
+	// grid cells per heat cell side, a power of two up to CHUNK_SIZE
+	int resolution = 2;
+	int interval = 2;
+	// share exchanged with each neighbour per heat step, at most 0.25
+	float diffusion = 0.2f;
+	float ambient = 20.0f;
+	// pull towards ambient per heat step
+	float cooling = 0.01f;
+	// pull of a heat source on its heat cell per heat step
+	float coupling = 0.5f;
+};
+
+enum THERMAL_RULE {
+	THERMAL_SOURCE, // the particle holds its heat cell at temperature
+	THERMAL_ABOVE,  // the particle becomes result when hotter than temperature
+	THERMAL_BELOW,  // the particle becomes result when colder than temperature
+};
+
+struct ThermalRule {
+	THERMAL_RULE kind = THERMAL_SOURCE;
+	std::string particle;
+	float temperature = 0.0f;
+	std::string result;
+};
+
+// optional velocity for SOLID and FLUID cells, see velocity.cpp. a cell
+// falling freely speeds up and covers several cells per Update() along a
+// line, stopping in front of the first occupied cell or reacting with it
+struct VelocitySettings {
+	// cells per step gained every step while falling
+	float gravity = 0.25f;
+	// cells per step, clamped below CHUNK_SIZE / 2 so a move never reaches
+	// a chunk updated in the same phase
+	float maxSpeed = 8.0f;
+	// share of its fall speed a landing FLUID keeps as sideways speed
+	float splash = 0.5f;
+	// sideways speed lost per step
+	float drag = 0.25f;
+};
+
+// velocities are int8 fixed point, VELOCITY_ONE per cell per step
+#define VELOCITY_SHIFT 2
+#define VELOCITY_ONE (1 << VELOCITY_SHIFT)
+
+struct Velocity {
+	int8_t x = 0, y = 0;
+};
+static_assert(sizeof(Velocity) == 2, "Velocity must stay two bytes");
+
+class ReplayRecorder;
+
+class ParticleWorld {
+protected:
+    std::vector<Cell> cells;
+    size_t width, height;
+
+	// per-type data, indexed by ParticleID
+	std::vector<Particle> particleRegistry;
+	std::unordered_map<std::string, ParticleID> particleIDs;
+	std::vector<InteractionRule> interactionRules;
+
+	// reactionTable[a * reactionStride + b] is the result of a touching b,
+	// rebuilt from interactionRules whenever a type or rule is added
+	std::vector<ParticleID> reactionTable;
+	size_t reactionStride;
+
+	void AddInteractionRule(const InteractionRule& rule);
+	void CompileInteractions();
+	void CompileMoveTables();
+	inline ParticleID ReactionResult(ParticleID a, ParticleID b) const {
+		return reactionTable[a * reactionStride + b];
+	}
+
+	size_t chunkCols, chunkRows;
+	std::vector<Chunk> chunks;
+	std::vector<size_t> phaseChunks[4];
+	std::vector<size_t> scheduled;
+	std::unique_ptr<WorkerPool> pool;
+	uint64_t seed;
+	uint64_t frame;
+	std::vector<uint8_t> moveStamps;
+	uint8_t stampTag;
+
+	// world chunk that window chunk (0, 0) holds, see ShiftWindow()
+	int32_t originChunkX, originChunkY;
+
+	// empty unless EnableHeat() was called, so it costs one branch per frame
+	HeatSettings heatSettings;
+	size_t heatWidth, heatHeight;
+	int heatShift;
+	std::vector<float> heat;
+	std::vector<float> heatScratch;
+	std::vector<ThermalRule> thermalRules;
+	// per ParticleID, compiled from thermalRules
+	std::vector<float> heatPull;
+	std::vector<float> heatSource;
+	std::vector<float> changeAbove, changeBelow;
+	std::vector<ParticleID> changeAboveInto, changeBelowInto;
+	// 1 for types that are a source or change phase
+	std::vector<uint8_t> heatActs;
+
+	void AddThermalRule(const ThermalRule& rule);
+	void CompileHeatTables();
+	void UpdateHeat();
+	void DiffuseHeatRows(size_t y0, size_t y1);
+	void HeatChunk(size_t chunk);
+
+	// empty unless EnableVelocity() was called. only cells that moved last
+	// step hold anything but zero; the rest are fixed point limits from
+	// velocitySettings
+	VelocitySettings velocitySettings;
+	std::vector<Velocity> velocity;
+	int gravityStep, speedCap, dragStep, splashShare;
+
+	Velocity Accelerate(Velocity v) const;
+	bool Traverse(int x, int y, ParticleID id, bool fluid, Velocity& v, SimRng& rng, Chunk& out);
+	void ClearVelocity(const CellRect& rect);
+
+	// logs every outside change and tick when set, see replay_log.h
+	ReplayRecorder* recorder;
+
+	UPDATE_KERNEL kernel;
+	// per ParticleID: first move rule is an unconditional fall into empty
+	std::vector<uint8_t> fallsStraight;
+
+	void UpdateChunk(size_t chunk);
+	void UpdateRegion(int x0, int y0, int x1, int y1, SimRng& rng, Chunk& out);
+	void FallRow(int x0, int x1, int y, bool leavesChunk, Chunk& out);
+	template<PARTICLE_TYPE T>
+	void StepCell(int x, int y, ParticleID id, SimRng& rng, Chunk& out);
+	void MarkChanged(const CellRect& rect);
+	void MarkAllDirty();
+	CellRect ChunkBounds(size_t cx, size_t cy) const;
+	CellRect FillDisc(ParticleID id, int cx, int cy, float radius);
+public:
+	ParticleWorld(size_t width, size_t height);
+	virtual ~ParticleWorld();
+
+    void RegisterParticle(const Particle& prototype);
+    void InsertParticle(std::string typeName, Vector2 pos);
+
+	// brushes write straight into the grid and wake only the chunks they
+	// touch; cells outside the grid are clipped, EMPTY_PARTICLE erases
+	void InsertParticles(ParticleID id, const Vector2* positions, size_t count);
+	void FillRect(ParticleID id, Rectangle rect);
+	void FillCircle(ParticleID id, Vector2 center, float radius);
+	void FillLine(ParticleID id, Vector2 from, Vector2 to, float radius);
+	void SetParticleInteraction(std::string particleOne, std::string particleTwo, std::string particleResult);
+	void InteractionTypeToType(PARTICLE_TYPE typeOne, PARTICLE_TYPE typeTwo, std::string particleResult);
+	void InteractionTypeToParticle(PARTICLE_TYPE type, std::string particle, std::string particleResult);
+
+	// 0 picks the hardware thread count, 1 runs Update() on the caller only
+	void SetThreadCount(size_t threads);
+	size_t GetThreadCount() const;
+	// the same seed always gives the same simulation, whatever the thread count
+	void SetSeed(uint64_t seed);
+	uint64_t GetSeed() const;
+	// Update() calls since the last SetSeed()
+	uint64_t GetFrame() const;
+	// 64-bit FNV-1a over the ID plane, for replay checkpoints
+	uint64_t GridHash() const;
+	// nullptr stops recording; the recorder must outlive the attachment
+	void SetRecorder(ReplayRecorder* recorder);
+	size_t ActiveChunkCount() const;
+	void SetUpdateKernel(UPDATE_KERNEL kernel);
+	UPDATE_KERNEL GetUpdateKernel() const;
+
+	// resolution is rounded down to a power of two in [1, CHUNK_SIZE];
+	// the field starts out at ambient everywhere
+	void EnableHeat(const HeatSettings& settings);
+	void DisableHeat();
+	bool HeatEnabled() const;
+	const HeatSettings& GetHeatSettings() const;
+	// e.g. LAVA held at 1200, WATER above 100 becomes STEAM
+	void SetParticleTemperature(std::string particle, float temperature);
+	void SetPhaseChangeAbove(std::string particle, float temperature, std::string result);
+	void SetPhaseChangeBelow(std::string particle, float temperature, std::string result);
+	const std::vector<ThermalRule>& GetThermalRules() const;
+	// ambient outside the grid or with the field off
+	float GetTemperature(Vector2 canvas) const;
+	const float* GetHeat() const;
+	size_t GetHeatWidth() const;
+	size_t GetHeatHeight() const;
+
+	// maxSpeed is clamped to [1, CHUNK_SIZE / 2 - 1], everything starts at
+	// rest. KERNEL_SIMD falls back to the scalar rules while this is on
+	void EnableVelocity(const VelocitySettings& settings);
+	void DisableVelocity();
+	bool VelocityEnabled() const;
+	const VelocitySettings& GetVelocitySettings() const;
+	// zero outside the grid or with velocity off, in cells per step
+	Vector2 GetVelocity(Vector2 canvas) const;
+
+	// binary checkpoint of the registry, rules, reaction table, rng state
+	// and grid; compress stores the grid as per-chunk runs instead of a
+	// raw plane. Loading needs a world of the same size, see snapshot.cpp
+	bool SaveSnapshot(const std::string& path, bool compress);
+	bool LoadSnapshot(const std::string& path);
+	static bool ReadSnapshotSize(const std::string& path, size_t& width, size_t& height);
+
+	// the grid can be a window onto a larger world, see chunk_streamer.h.
+	// ShiftWindow() moves the window by whole chunks: cells keep their world
+	// position and the chunks scrolled in start empty
+	void ShiftWindow(int dcx, int dcy);
+	int32_t GetOriginChunkX() const;
+	int32_t GetOriginChunkY() const;
+	// world cell of grid cell (0, 0)
+	Vector2 GetOrigin() const;
+	size_t GetChunkCols() const;
+	size_t GetChunkRows() const;
+	// one window chunk as runs (see chunk_codec.h), appended to out
+	void EncodeChunk(size_t cx, size_t cy, std::vector<uint8_t>& out) const;
+	// false, leaving the chunk empty, if the runs do not fit it or hold unknown IDs
+	bool DecodeChunk(size_t cx, size_t cy, const uint8_t* data, size_t size);
+
+	size_t GetWidth() const;
+	size_t GetHeight() const;
+	const Cell* GetCells() const;
+	// EMPTY_PARTICLE if the type is not registered
+	ParticleID GetParticleID(const std::string& typeName) const;
+	const Particle& GetParticle(ParticleID id) const;
+	size_t GetParticleTypeCount() const;
+	const std::vector<InteractionRule>& GetInteractionRules() const;
+
+    void Update();
+};
+
+
+#endif
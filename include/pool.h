@@ -0,0 +1,91 @@
+#pragma once
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// stable reference to an object in a Pool. the generation goes up every
+// time a slot is released, so a handle kept past Release() goes stale
+// instead of pointing at whatever took the slot next
+struct PoolHandle {
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+};
+
+// arena of T with free-list recycling. released objects are not destroyed,
+// the next Acquire() hands the same object back as it was left, so buffers
+// it holds keep their capacity and a slot reused in steady state costs no
+// allocation. clear what needs clearing after Acquire().
+// pointers from Get() stay valid until the next Acquire() grows the pool,
+// handles stay valid until their Release().
+template <typename T>
+class Pool {
+private:
+	std::vector<T> items;
+	std::vector<uint32_t> generations;
+	std::vector<uint32_t> freeList;
+	size_t live = 0;
+public:
+	void Reserve(size_t n)
+	{
+		items.reserve(n);
+		generations.reserve(n);
+		freeList.reserve(n);
+	}
+
+	PoolHandle Acquire()
+	{
+		uint32_t index;
+		if(!freeList.empty()){
+			index = freeList.back();
+			freeList.pop_back();
+		}else{
+			index = (uint32_t)items.size();
+			items.emplace_back();
+			generations.push_back(0);
+		}
+		++live;
+		return PoolHandle{index, generations[index]};
+	}
+
+	void Release(PoolHandle handle)
+	{
+		if(!Valid(handle))
+			return;
+		++generations[handle.index];
+		freeList.push_back(handle.index);
+		--live;
+	}
+
+	bool Valid(PoolHandle handle) const
+	{
+		return handle.index < items.size() && generations[handle.index] == handle.generation;
+	}
+
+	// nullptr for a stale handle
+	T* Get(PoolHandle handle)
+	{
+		return Valid(handle) ? &items[handle.index] : nullptr;
+	}
+
+	const T* Get(PoolHandle handle) const
+	{
+		return Valid(handle) ? &items[handle.index] : nullptr;
+	}
+
+	// objects handed out and not released
+	size_t Size() const
+	{
+		return live;
+	}
+
+	// objects ever created, live or waiting on the free list
+	size_t Capacity() const
+	{
+		return items.size();
+	}
+};
+
+#endif
@@ -0,0 +1,117 @@
+#pragma once
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// frame profiler: per-zone timings and simulation counters per frame,
+// kept for the last PROFILE_HISTORY frames and dumpable as a Chrome trace
+// (chrome://tracing or ui.perfetto.dev). the macros below compile to
+// nothing unless PHYSSIM_PROFILE is defined (cmake -DPHYSSIM_PROFILE=ON),
+// the Profiler itself always exists and just reads zeros then.
+// zones and counters may come from any thread, e.g. Update() on a
+// StepThread next to Render(); pool workers keep their counts in their
+// Chunk until the phase merge instead.
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum PROFILE_ZONE {
+	ZONE_UPDATE,
+	ZONE_UPDATE_PHASE,
+	ZONE_HEAT,
+	ZONE_PUBLISH,
+	ZONE_UPDATE_COLORS,
+	ZONE_UPDATE_TEXTURES,
+	ZONE_DRAW,
+	ZONE_DEBUG_TEXT,
+	ZONE_COUNT,
+};
+
+enum PROFILE_COUNTER {
+	COUNTER_CELLS_VISITED,
+	COUNTER_SWAPS,
+	COUNTER_REACTIONS,
+	COUNTER_ALLOCATIONS, // operator new calls, counted in profiled builds only
+	COUNTER_ACTIVE_CHUNKS,
+	COUNTER_COUNT,
+};
+
+#define PROFILE_HISTORY 240
+#define PROFILE_MAX_EVENTS 65536
+
+struct ProfileFrame {
+	uint64_t index = 0;
+	int64_t startUs = 0;
+	double zoneMs[ZONE_COUNT] = {};
+	uint64_t counters[COUNTER_COUNT] = {};
+};
+
+class Profiler {
+private:
+	struct Event {
+		PROFILE_ZONE zone;
+		int thread;
+		int64_t startUs;
+		int64_t durationUs;
+	};
+
+	std::mutex mutex;
+	std::chrono::steady_clock::time_point epoch;
+	std::vector<ProfileFrame> frames;
+	std::vector<Event> events;
+	uint64_t frameCount;
+	size_t eventCount;
+	uint64_t allocationsAtFrameStart;
+
+	Profiler();
+public:
+	static Profiler& Get();
+	static const char* ZoneName(PROFILE_ZONE zone);
+	static const char* CounterName(PROFILE_COUNTER counter);
+	// operator new calls so far, 0 unless built with PHYSSIM_PROFILE
+	static uint64_t AllocationCount();
+
+	int64_t NowUs() const;
+	// closes the current frame and starts the next one
+	void NextFrame();
+	void AddZone(PROFILE_ZONE zone, int64_t startUs, int64_t endUs);
+	void Count(PROFILE_COUNTER counter, uint64_t n);
+
+	// the frame being recorded, and the newest finished one
+	const ProfileFrame& CurrentFrame() const;
+	const ProfileFrame& LastFrame() const;
+	// back = 0 is LastFrame(), up to PROFILE_HISTORY - 2
+	const ProfileFrame& History(size_t back) const;
+	size_t HistorySize() const;
+
+	// the recorded history as Chrome trace JSON
+	bool WriteChromeTrace(const std::string& path) const;
+};
+
+// times the rest of the enclosing block
+class ProfileScope {
+private:
+	PROFILE_ZONE zone;
+	int64_t startUs;
+public:
+	ProfileScope(PROFILE_ZONE zone) : zone(zone), startUs(Profiler::Get().NowUs()) {}
+	~ProfileScope() { Profiler::Get().AddZone(zone, startUs, Profiler::Get().NowUs()); }
+};
+
+#ifdef PHYSSIM_PROFILE
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(zone) ProfileScope PROFILE_JOIN(profileScope, __LINE__)(zone)
+#define PROFILE_COUNT(counter, n) Profiler::Get().Count(counter, (uint64_t)(n))
+#define PROFILE_NEXT_FRAME() Profiler::Get().NextFrame()
+#define PROFILE_ONLY(...) __VA_ARGS__
+#else
+#define PROFILE_SCOPE(zone) ((void)0)
+#define PROFILE_COUNT(counter, n) ((void)0)
+#define PROFILE_NEXT_FRAME() ((void)0)
+#define PROFILE_ONLY(...)
+#endif
+
+#endif
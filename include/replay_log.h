@@ -0,0 +1,74 @@
+#pragma once
+#ifndef REPLAY_LOG_H
+#define REPLAY_LOG_H
+
+#include <cstdio>
+#include <string>
+#include <raylib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "particle_world.h"
+
+// lockstep replay logs. a recorder attached to a world with SetRecorder()
+// logs everything that changes it from outside Update() (registrations,
+// rules, brushes, seed, kernel, heat settings and thermal rules, velocity
+// settings, window shifts, streamed-in chunks, loaded snapshots) together
+// with the ticks in between, and a grid hash every checkpointInterval
+// ticks. Update() is deterministic for a given seed, so replaying the log
+// on a fresh world of the same size has to hit every hash, see
+// src/replay.cpp.
+
+struct ReplayResult {
+	uint64_t ticks = 0;
+	uint64_t checkpoints = 0;
+	uint64_t mismatches = 0;
+	// frame of the first checkpoint that did not match, 0 if none
+	uint64_t firstMismatch = 0;
+};
+
+class ReplayRecorder {
+private:
+	FILE* file;
+	std::vector<uint8_t> buffer;
+	uint32_t pendingTicks;
+	uint32_t checkpointInterval;
+
+	void FlushTicks();
+	void Flush();
+public:
+	ReplayRecorder();
+	~ReplayRecorder();
+
+	// the world must be freshly constructed, nothing it holds is logged
+	bool Open(const std::string& path, const ParticleWorld& world, uint32_t checkpointInterval);
+	bool Close();
+	bool IsOpen() const;
+
+	// called by the world it is attached to
+	void RegisterParticle(const Particle& prototype);
+	void AddInteractionRule(const InteractionRule& rule);
+	void InsertParticle(const std::string& typeName, Vector2 pos);
+	void InsertParticles(ParticleID id, const Vector2* positions, size_t count);
+	void FillRect(ParticleID id, Rectangle rect);
+	void FillCircle(ParticleID id, Vector2 center, float radius);
+	void FillLine(ParticleID id, Vector2 from, Vector2 to, float radius);
+	void SetSeed(uint64_t seed);
+	void SetUpdateKernel(UPDATE_KERNEL kernel);
+	void ShiftWindow(int dcx, int dcy);
+	void DecodeChunk(size_t cx, size_t cy, const uint8_t* data, size_t size);
+	void LoadSnapshot(const std::string& path);
+	void EnableHeat(const HeatSettings& settings);
+	void DisableHeat();
+	void AddThermalRule(const ThermalRule& rule);
+	void EnableVelocity(const VelocitySettings& settings);
+	void DisableVelocity();
+	void Tick(const ParticleWorld& world);
+};
+
+bool ReadReplaySize(const std::string& path, size_t& width, size_t& height);
+// runs the whole log on world, which must be fresh and of the logged size;
+// false if the log cannot be read, mismatches are reported in result
+bool RunReplay(const std::string& path, ParticleWorld& world, ReplayResult& result);
+
+#endif
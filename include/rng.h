@@ -0,0 +1,55 @@
+#pragma once
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// small explicitly seeded generators for the simulation step, cheap enough
+// to create one per chunk per frame. SimRng is the one Update() uses.
+
+inline uint64_t SplitMix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+// xoshiro128++ by Blackman and Vigna, 16 bytes of state
+struct Xoshiro128pp {
+	typedef uint32_t result_type;
+	uint32_t s[4];
+
+	explicit Xoshiro128pp(uint64_t seed = 0) { Seed(seed); }
+
+	void Seed(uint64_t seed) {
+		uint64_t a = SplitMix64(seed);
+		uint64_t b = SplitMix64(a);
+		s[0] = (uint32_t)a; s[1] = (uint32_t)(a >> 32);
+		s[2] = (uint32_t)b; s[3] = (uint32_t)(b >> 32);
+	}
+
+	uint32_t Next() {
+		uint32_t result = Rotl(s[0] + s[3], 7) + s[0];
+		uint32_t t = s[1] << 9;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = Rotl(s[3], 11);
+		return result;
+	}
+
+	static uint32_t Rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+
+	static constexpr uint32_t min() { return 0; }
+	static constexpr uint32_t max() { return 0xFFFFFFFFu; }
+	uint32_t operator()() { return Next(); }
+	// uniform in [0, 1)
+	float NextFloat() { return (Next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+typedef Xoshiro128pp SimRng;
+
+#endif
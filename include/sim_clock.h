@@ -0,0 +1,30 @@
+#pragma once
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// fixed-timestep clock: real time accumulates and is paid out in whole
+// steps of 1/stepsPerSecond, so the simulation runs at the same speed
+// whatever the display does. a frame may get several steps or none.
+class SimulationClock {
+private:
+	double stepSeconds;
+	int maxStepsPerFrame;
+	double accumulator;
+	uint64_t droppedSteps;
+public:
+	SimulationClock(double stepsPerSecond, int maxStepsPerFrame);
+
+	// steps owed for elapsedSeconds of real time; a backlog past
+	// maxStepsPerFrame is dropped so one slow frame cannot snowball
+	int Advance(double elapsedSeconds);
+	void SetRate(double stepsPerSecond);
+	double GetStepSeconds() const;
+	// how far into the next step the clock is, in [0, 1)
+	double GetAlpha() const;
+	uint64_t GetDroppedSteps() const;
+};
+
+#endif
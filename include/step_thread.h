@@ -0,0 +1,34 @@
+#pragma once
+#ifndef STEP_THREAD_H
+#define STEP_THREAD_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "particle_world.h"
+
+// runs ParticleWorld::Update() on its own thread so the caller can build
+// and upload the previous frame meanwhile. the world belongs to this
+// thread from Start() until Wait() returns: inputs, brushes and rule
+// changes go in between, never during.
+class StepThread {
+private:
+	ParticleWorld& world;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	int pendingSteps;
+	bool stopping;
+
+	void ThreadLoop();
+public:
+	StepThread(ParticleWorld& world);
+	~StepThread();
+
+	// returns at once, steps may be 0
+	void Start(int steps);
+	void Wait();
+};
+
+#endif
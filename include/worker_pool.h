@@ -0,0 +1,47 @@
+#pragma once
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of threads that run a batch of indexed jobs and block until
+// every job is done; the calling thread works on the batch too
+class WorkerPool {
+private:
+	typedef void (*JobFn)(void* ctx, size_t job);
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	JobFn jobFn = nullptr;
+	void* jobCtx = nullptr;
+	size_t jobCount = 0;
+	std::atomic<size_t> nextJob{0};
+	size_t generation = 0;
+	size_t busy = 0;
+	bool stopping = false;
+
+	void WorkerLoop();
+	void Drain();
+	void RunJobs(size_t count, JobFn fn, void* ctx);
+public:
+	WorkerPool(size_t threadCount);
+	~WorkerPool();
+
+	size_t Size() const { return workers.size() + 1; }
+
+	// calls job(i) for every i in [0, count)
+	template<typename F>
+	void Run(size_t count, F& job) {
+		RunJobs(count, [](void* ctx, size_t i){ (*(F*)ctx)(i); }, &job);
+	}
+};
+
+#endif
@@ -0,0 +1,30 @@
+#include "alloc_counter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// every allocation in a process this is linked into goes through here
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if(void* p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+uint64_t CountedAllocations()
+{
+	return allocations.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,259 @@
+// headless throughput benchmark, one JSON object per line on stdout:
+//   bench [--steps N] [--sizes 256,512,1024] [--threads N] [--seed S]
+//         [--scenes sand_pile,water_lava,settled,churn,rain] [--render per-type|packed]
+//         [--kernel scalar|simd] [--trace out.json] [--pipeline] [--heat N]
+//         [--velocity]
+// --render opens a hidden window so colour building and uploads can be
+// timed as well, without it only Update() is measured. --pipeline (with
+// --render) runs Update() on a StepThread overlapped with the colour build
+// and upload of the previous step, as the app does; frame_ns_per_cell is
+// the wall time either way. --kernel simd runs a different simulation from
+// scalar (see move_rules.h), so compare the two kernels as throughput on
+// similar scenes, not step for step. --heat N turns on the heat field at a
+// resolution of N cells per heat cell, stepped every other frame.
+// --velocity lets falling cells speed up and move several cells a step;
+// settled_at is the first step after which no chunk is awake, if any.
+// --trace writes the profiler history as Chrome trace JSON, which needs
+// -DPHYSSIM_PROFILE=ON. so does steady_allocations, the operator new calls
+// over the second half of the steps, which should be 0 once a scene is
+// running.
+#include "particle_system.h"
+#include "particle_world.h"
+#include "bench_scenes.h"
+#include "fall_kernel.h"
+#include "profiler.h"
+#include "step_thread.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// set by the build to the source tree, so the shader is found from any
+// working directory
+#ifndef PHYSSIM_SHADER_DIR
+#define PHYSSIM_SHADER_DIR "../src"
+#endif
+#define MATERIAL_SHADER PHYSSIM_SHADER_DIR "/material.fs"
+
+struct BenchOptions {
+	int steps = 200;
+	std::vector<int> sizes = { 256, 512, 1024 };
+	std::vector<int> scenes = { SCENE_SAND_PILE, SCENE_WATER_LAVA, SCENE_SETTLED, SCENE_CHURN, SCENE_RAIN };
+	size_t threads = 1;
+	uint64_t seed = 1;
+	bool render = false;
+	bool packed = false;
+	bool pipeline = false;
+	int heat = 0;
+	bool velocity = false;
+	UPDATE_KERNEL kernel = KERNEL_SCALAR;
+	std::string trace;
+};
+
+static std::vector<int> ParseList(const char* arg)
+{
+	std::vector<int> out;
+	for(const char* p = arg; *p; ){
+		out.push_back(atoi(p));
+		const char* comma = strchr(p, ',');
+		if(!comma) break;
+		p = comma + 1;
+	}
+	return out;
+}
+
+static std::vector<int> ParseScenes(const char* arg)
+{
+	std::vector<int> out;
+	for(int s = 0; s < SCENE_COUNT; ++s)
+		if(strstr(arg, sceneNames[s]))
+			out.push_back(s);
+	return out;
+}
+
+static double Seconds(std::chrono::steady_clock::duration d)
+{
+	return std::chrono::duration<double>(d).count();
+}
+
+static void RunBench(const BenchOptions& opt, int scene, int size)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	std::unique_ptr<ParticleWorld> world;
+	ParticleSystem* renderer = nullptr;
+	if(opt.render){
+		renderer = new ParticleSystem(Rectangle{0, 0, (float)size, (float)size}, Vector2{1, 1});
+		if(opt.packed)
+			renderer->UsePackedRenderer(MATERIAL_SHADER);
+		world.reset(renderer);
+	}else{
+		world.reset(new ParticleWorld(size, size));
+	}
+
+	world->SetSeed(opt.seed);
+	world->SetThreadCount(opt.threads);
+	world->SetUpdateKernel(opt.kernel);
+	RegisterScenePalette(*world, opt.heat);
+	if(opt.velocity)
+		world->EnableVelocity(VelocitySettings{});
+	BuildScene(*world, scene, opt.seed);
+
+	bool pipelined = renderer && opt.pipeline;
+	std::unique_ptr<StepThread> stepper;
+	if(pipelined){
+		renderer->SetPipelined(true);
+		stepper.reset(new StepThread(*world));
+	}
+
+	Clock::duration update{}, colors{}, upload{};
+	size_t activeChunks = 0;
+	int settledAt = -1;
+	uint64_t allocationsAtHalf = 0;
+	Clock::time_point start = Clock::now();
+	for(int step = 0; step < opt.steps; ++step){
+		PROFILE_NEXT_FRAME();
+		if(step == opt.steps / 2)
+			allocationsAtHalf = Profiler::AllocationCount();
+		Clock::time_point t0 = Clock::now();
+		if(pipelined){
+			// this step runs while the previous one is coloured and uploaded
+			stepper->Wait();
+			activeChunks += world->ActiveChunkCount();
+			if(settledAt < 0 && step > 0 && world->ActiveChunkCount() == 0)
+				settledAt = step;
+			renderer->PublishFrame();
+			stepper->Start(1);
+		}else{
+			world->Update();
+			activeChunks += world->ActiveChunkCount();
+			if(settledAt < 0 && world->ActiveChunkCount() == 0)
+				settledAt = step + 1;
+		}
+		Clock::time_point t1 = Clock::now();
+		update += t1 - t0;
+
+		if(renderer){
+			renderer->UpdateColors();
+			Clock::time_point t2 = Clock::now();
+			renderer->UpdateTextures();
+			Clock::time_point t3 = Clock::now();
+			colors += t2 - t1;
+			upload += t3 - t2;
+		}
+	}
+	if(pipelined)
+		stepper->Wait();
+	Clock::duration frame = Clock::now() - start;
+	uint64_t steadyAllocations = Profiler::AllocationCount() - allocationsAtHalf;
+
+	double cells = (double)size * size * opt.steps;
+	printf("{\"scene\":\"%s\",\"width\":%d,\"height\":%d,\"steps\":%d,\"threads\":%zu,\"seed\":%llu,\"kernel\":\"%s\",",
+		   sceneNames[scene], size, size, opt.steps, world->GetThreadCount(), (unsigned long long)opt.seed,
+		   opt.kernel == KERNEL_SIMD ? FallKernelName() : "scalar");
+	// pipelined, Update() is hidden behind the render work and cannot be timed alone
+	if(pipelined)
+		printf("\"update_cells_per_sec\":null,\"update_ns_per_cell\":null,");
+	else
+		printf("\"update_cells_per_sec\":%.1f,\"update_ns_per_cell\":%.4f,", cells / Seconds(update), Seconds(update) * 1e9 / cells);
+	if(renderer)
+		printf("\"render\":\"%s\",\"colors_ns_per_cell\":%.4f,\"upload_ns_per_cell\":%.4f,",
+			   opt.packed ? "packed" : "per-type", Seconds(colors) * 1e9 / cells, Seconds(upload) * 1e9 / cells);
+	else
+		printf("\"render\":null,\"colors_ns_per_cell\":null,\"upload_ns_per_cell\":null,");
+	printf("\"velocity\":%s,", world->VelocityEnabled() ? "true" : "false");
+	if(settledAt >= 0)
+		printf("\"settled_at\":%d,", settledAt);
+	else
+		printf("\"settled_at\":null,");
+	printf("\"heat\":%d,\"pipelined\":%s,\"frame_ns_per_cell\":%.4f,", world->HeatEnabled() ? world->GetHeatSettings().resolution : 0, pipelined ? "true" : "false", Seconds(frame) * 1e9 / cells);
+#ifdef PHYSSIM_PROFILE
+	printf("\"steady_allocations\":%llu,", (unsigned long long)steadyAllocations);
+#else
+	(void)steadyAllocations;
+	printf("\"steady_allocations\":null,");
+#endif
+	printf("\"avg_active_chunks\":%.2f}\n", (double)activeChunks / opt.steps);
+	fflush(stdout);
+}
+
+// hidden window for the GL context --render needs
+static bool OpenBenchWindow()
+{
+	SetTraceLogLevel(LOG_WARNING);
+	SetConfigFlags(FLAG_WINDOW_HIDDEN);
+#ifndef _WIN32
+	// when GLFW cannot start, e.g. with no display, raylib's InitWindow()
+	// crashes instead of returning, so try it in a child process first
+	pid_t child = fork();
+	if(child == 0){
+		InitWindow(64, 64, "bench");
+		_exit(IsWindowReady() ? 0 : 1);
+	}
+	int status = 0;
+	if(child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return false;
+#endif
+	InitWindow(64, 64, "bench");
+	return IsWindowReady();
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions opt;
+	for(int i = 1; i < argc; ++i){
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : "";
+		if(!strcmp(arg, "--steps"))        { opt.steps = atoi(value); ++i; }
+		else if(!strcmp(arg, "--sizes"))   { opt.sizes = ParseList(value); ++i; }
+		else if(!strcmp(arg, "--scenes"))  { opt.scenes = ParseScenes(value); ++i; }
+		else if(!strcmp(arg, "--threads")) { opt.threads = (size_t)atoi(value); ++i; }
+		else if(!strcmp(arg, "--seed"))    { opt.seed = strtoull(value, nullptr, 10); ++i; }
+		else if(!strcmp(arg, "--render"))  { opt.render = true; opt.packed = !strcmp(value, "packed"); ++i; }
+		else if(!strcmp(arg, "--kernel"))  { opt.kernel = !strcmp(value, "simd") ? KERNEL_SIMD : KERNEL_SCALAR; ++i; }
+		else if(!strcmp(arg, "--trace"))   { opt.trace = value; ++i; }
+		else if(!strcmp(arg, "--pipeline")){ opt.pipeline = true; }
+		else if(!strcmp(arg, "--heat"))    { opt.heat = atoi(value); ++i; }
+		else if(!strcmp(arg, "--velocity")){ opt.velocity = true; }
+		else{
+			fprintf(stderr, "unknown option %s\n", arg);
+			return 1;
+		}
+	}
+	if(opt.steps <= 0){
+		fprintf(stderr, "--steps must be positive\n");
+		return 1;
+	}
+
+	if(opt.render){
+		if(!OpenBenchWindow()){
+			fprintf(stderr, "could not open a window for --render\n");
+			return 1;
+		}
+		if(opt.packed && !FileExists(MATERIAL_SHADER)){
+			fprintf(stderr, "could not find %s for --render packed\n", MATERIAL_SHADER);
+			CloseWindow();
+			return 1;
+		}
+	}
+
+	for(int size : opt.sizes)
+		for(int scene : opt.scenes)
+			RunBench(opt, scene, size);
+
+	if(!opt.trace.empty() && !Profiler::Get().WriteChromeTrace(opt.trace)){
+		fprintf(stderr, "could not write %s\n", opt.trace.c_str());
+		return 1;
+	}
+	if(opt.render)
+		CloseWindow();
+	return 0;
+}
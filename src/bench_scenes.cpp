@@ -0,0 +1,73 @@
+#include "bench_scenes.h"
+#include <random>
+#include <vector>
+
+const char* sceneNames[SCENE_COUNT] = { "sand_pile", "water_lava", "settled", "churn", "rain" };
+
+void RegisterScenePalette(ParticleWorld& world, int heat)
+{
+    world.RegisterParticle(GenSolidParticle("STONE", GRAY, 0.6f));
+    world.RegisterParticle(GenSolidParticle("OBSIDIAN", BLACK, 0.9f));
+    world.RegisterParticle(GenFluidParticle("WATER", BLUE, 0.1));
+    world.RegisterParticle(GenFluidParticle("LAVA", RED, 0.4));
+    world.RegisterParticle(GenSolidParticle("SAND", BEIGE, 0.2));
+    world.RegisterParticle(GenSolidParticle("MUD", BROWN, 0.3f));
+	world.SetParticleInteraction("SAND", "WATER", "MUD");
+	world.SetParticleInteraction("WATER", "LAVA", "OBSIDIAN");
+	if(heat <= 0)
+		return;
+
+    world.RegisterParticle(GenParticle("STEAM", GAS, LIGHTGRAY, 0.05f));
+	HeatSettings settings;
+	settings.resolution = heat;
+	world.EnableHeat(settings);
+	world.SetParticleTemperature("LAVA", 1200.0f);
+	world.SetPhaseChangeAbove("WATER", 100.0f, "STEAM");
+	world.SetPhaseChangeBelow("STEAM", 60.0f, "WATER");
+}
+
+void BuildScene(ParticleWorld& world, int scene, uint64_t seed)
+{
+	float w = (float)world.GetWidth();
+	float h = (float)world.GetHeight();
+	std::mt19937_64 rng(seed);
+	std::vector<Vector2> water, lava, sand;
+
+	switch(scene){
+		case SCENE_SAND_PILE:
+			// a block of sand over the middle that collapses into a pile
+			world.FillRect(world.GetParticleID("SAND"), Rectangle{w*3/8, 0, w/4, h/2});
+			break;
+		case SCENE_WATER_LAVA:
+			// interleaved blobs that keep reacting into obsidian
+			for(int y = 0; y < (int)h/2; ++y)
+				for(int x = 0; x < (int)w; ++x)
+					if(rng() % 3 == 0)
+						(((x / 8) + (y / 8)) % 2 ? water : lava).push_back(Vector2{(float)x, (float)y});
+			world.InsertParticles(world.GetParticleID("WATER"), water.data(), water.size());
+			world.InsertParticles(world.GetParticleID("LAVA"), lava.data(), lava.size());
+			break;
+		case SCENE_SETTLED:
+			// a resting floor of stone with a thin stream of sand on top
+			world.FillRect(world.GetParticleID("STONE"), Rectangle{0, h/5, w, h - h/5});
+			world.FillRect(world.GetParticleID("SAND"), Rectangle{w/2 - 2, 0, 4, h/10});
+			break;
+		case SCENE_CHURN:
+			// half-full water everywhere never settles
+			for(int y = 0; y < (int)h; ++y)
+				for(int x = 0; x < (int)w; ++x)
+					if(rng() % 2 == 0)
+						water.push_back(Vector2{(float)x, (float)y});
+			world.InsertParticles(world.GetParticleID("WATER"), water.data(), water.size());
+			break;
+		case SCENE_RAIN:
+			// scattered grains over a stone floor, settled once they all landed
+			world.FillRect(world.GetParticleID("STONE"), Rectangle{0, h - 1, w, 1});
+			for(int y = 0; y < (int)h/2; ++y)
+				for(int x = 0; x < (int)w; ++x)
+					if(rng() % 16 == 0)
+						sand.push_back(Vector2{(float)x, (float)y});
+			world.InsertParticles(world.GetParticleID("SAND"), sand.data(), sand.size());
+			break;
+	}
+}
@@ -0,0 +1,61 @@
+#include "chunk_codec.h"
+#include <algorithm>
+
+static void PutRun(std::vector<uint8_t>& out, ParticleID id, uint32_t length)
+{
+	while(length > 0){
+		uint16_t n = length > 0xFFFF ? 0xFFFF : (uint16_t)length;
+		out.push_back(id);
+		out.push_back((uint8_t)(n & 0xFF));
+		out.push_back((uint8_t)(n >> 8));
+		length -= n;
+	}
+}
+
+void EncodeCellsRLE(const Cell* grid, size_t gridWidth, const CellRect& rect, std::vector<uint8_t>& out)
+{
+	if(rect.Empty())
+		return;
+
+	ParticleID run = grid[rect.y0 * gridWidth + rect.x0].id;
+	uint32_t length = 0;
+	for(int y = rect.y0; y < rect.y1; ++y){
+		const Cell* row = grid + y * gridWidth;
+		for(int x = rect.x0; x < rect.x1; ++x){
+			if(row[x].id != run){
+				PutRun(out, run, length);
+				run = row[x].id;
+				length = 0;
+			}
+			++length;
+		}
+	}
+	PutRun(out, run, length);
+}
+
+bool DecodeCellsRLE(const uint8_t* data, size_t size, Cell* grid, size_t gridWidth, const CellRect& rect)
+{
+	if(size % 3 != 0)
+		return false;
+
+	int x = rect.x0, y = rect.y0;
+	for(size_t i = 0; i < size; i += 3){
+		ParticleID id = data[i];
+		uint32_t length = data[i + 1] | (data[i + 2] << 8);
+		while(length > 0){
+			if(y >= rect.y1)
+				return false;
+			uint32_t span = std::min<uint32_t>(length, rect.x1 - x);
+			Cell* row = grid + y * gridWidth;
+			for(uint32_t k = 0; k < span; ++k)
+				row[x + k].id = id;
+			x += span;
+			length -= span;
+			if(x == rect.x1){
+				x = rect.x0;
+				++y;
+			}
+		}
+	}
+	return y == rect.y1 && x == rect.x0;
+}
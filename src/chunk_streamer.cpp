@@ -0,0 +1,163 @@
+#include "chunk_streamer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+ChunkStreamer::ChunkStreamer(ParticleWorld& world, std::string pageDirectory, size_t cacheLimit)
+	: world(world)
+{
+	this->pageDirectory = pageDirectory;
+	this->cacheLimit = cacheLimit;
+	tick = 0;
+
+	// a partial edge chunk would lose its missing part every time it scrolls out
+	usable = world.GetWidth() % CHUNK_SIZE == 0 && world.GetHeight() % CHUNK_SIZE == 0;
+
+	chunks.Reserve(cacheLimit);
+	stored.reserve(cacheLimit);
+
+	std::error_code ec;
+	std::filesystem::create_directories(pageDirectory, ec);
+}
+
+ChunkStreamer::~ChunkStreamer()
+{
+	for(auto& entry : stored)
+		if(chunks.Get(entry.second)->paged)
+			std::remove(PagePath(entry.first).c_str());
+}
+
+uint64_t ChunkStreamer::Key(int32_t cx, int32_t cy)
+{
+	return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+}
+
+std::string ChunkStreamer::PagePath(uint64_t key) const
+{
+	int32_t cx = (int32_t)(uint32_t)(key >> 32);
+	int32_t cy = (int32_t)(uint32_t)key;
+	return pageDirectory + "/" + std::to_string(cx) + "_" + std::to_string(cy) + ".chunk";
+}
+
+bool ChunkStreamer::Follow(Vector2 focus)
+{
+	int32_t cx = (int32_t)floorf(focus.x / CHUNK_SIZE);
+	int32_t cy = (int32_t)floorf(focus.y / CHUNK_SIZE);
+	return MoveTo(cx - (int32_t)world.GetChunkCols() / 2, cy - (int32_t)world.GetChunkRows() / 2);
+}
+
+bool ChunkStreamer::MoveTo(int32_t originChunkX, int32_t originChunkY)
+{
+	if(!usable)
+		return false;
+
+	int dcx = originChunkX - world.GetOriginChunkX();
+	int dcy = originChunkY - world.GetOriginChunkY();
+	if(dcx == 0 && dcy == 0)
+		return true;
+	++tick;
+
+	int cols = (int)world.GetChunkCols();
+	int rows = (int)world.GetChunkRows();
+	for(int cy = 0; cy < rows; ++cy)
+		for(int cx = 0; cx < cols; ++cx)
+			if(cx - dcx < 0 || cx - dcx >= cols || cy - dcy < 0 || cy - dcy >= rows)
+				StoreChunk(cx, cy);
+
+	world.ShiftWindow(dcx, dcy);
+
+	for(int cy = 0; cy < rows; ++cy)
+		for(int cx = 0; cx < cols; ++cx)
+			if(cx + dcx < 0 || cx + dcx >= cols || cy + dcy < 0 || cy + dcy >= rows)
+				LoadChunk(cx, cy);
+
+	PageOut();
+	return true;
+}
+
+void ChunkStreamer::StoreChunk(size_t cx, size_t cy)
+{
+	uint64_t key = Key(world.GetOriginChunkX() + (int32_t)cx, world.GetOriginChunkY() + (int32_t)cy);
+	scratch.clear();
+	world.EncodeChunk(cx, cy, scratch);
+
+	// a single run of nothing, storing it would only cost memory
+	if(scratch.size() == 3 && scratch[0] == EMPTY_PARTICLE)
+		return;
+
+	// never stored already: LoadChunk() dropped the record when the chunk
+	// came into the window, and the window only moves through MoveTo()
+	PoolHandle handle = chunks.Acquire();
+	stored.emplace(key, handle);
+	StoredChunk& chunk = *chunks.Get(handle);
+	chunk.runs.assign(scratch.begin(), scratch.end());
+	chunk.leftWindow = tick;
+	chunk.paged = false;
+}
+
+void ChunkStreamer::LoadChunk(size_t cx, size_t cy)
+{
+	uint64_t key = Key(world.GetOriginChunkX() + (int32_t)cx, world.GetOriginChunkY() + (int32_t)cy);
+	auto it = stored.find(key);
+	if(it == stored.end())
+		return;
+
+	StoredChunk& chunk = *chunks.Get(it->second);
+	if(chunk.paged){
+		std::string path = PagePath(key);
+		std::ifstream file(path, std::ios::binary);
+		scratch.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		world.DecodeChunk(cx, cy, scratch.data(), scratch.size());
+		file.close();
+		std::remove(path.c_str());
+	}else{
+		world.DecodeChunk(cx, cy, chunk.runs.data(), chunk.runs.size());
+	}
+	chunks.Release(it->second);
+	stored.erase(it);
+}
+
+void ChunkStreamer::PageOut()
+{
+	pageOrder.clear();
+	for(auto& entry : stored){
+		const StoredChunk& chunk = *chunks.Get(entry.second);
+		if(!chunk.paged)
+			pageOrder.push_back({chunk.leftWindow, entry.first});
+	}
+	if(pageOrder.size() <= cacheLimit)
+		return;
+
+	// the chunks that left the window longest ago go to disk first
+	size_t excess = pageOrder.size() - cacheLimit;
+	std::nth_element(pageOrder.begin(), pageOrder.begin() + (excess - 1), pageOrder.end());
+	for(size_t i = 0; i < excess; ++i){
+		StoredChunk& chunk = *chunks.Get(stored[pageOrder[i].second]);
+		std::ofstream file(PagePath(pageOrder[i].second), std::ios::binary | std::ios::trunc);
+		file.write((const char*)chunk.runs.data(), chunk.runs.size());
+		if(!file){
+			file.close();
+			std::remove(PagePath(pageOrder[i].second).c_str());
+			continue;
+		}
+		// paging out is about memory, so this one gives its buffer back
+		std::vector<uint8_t>().swap(chunk.runs);
+		chunk.paged = true;
+	}
+}
+
+size_t ChunkStreamer::StoredChunkCount() const
+{
+	return stored.size();
+}
+
+size_t ChunkStreamer::PagedChunkCount() const
+{
+	size_t n = 0;
+	for(const auto& entry : stored)
+		n += chunks.Get(entry.second)->paged;
+	return n;
+}
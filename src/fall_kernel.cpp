@@ -0,0 +1,89 @@
+#include "fall_kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FALL_KERNEL_X86 1
+#endif
+
+static uint64_t FallCandidatesScalar(const Cell* cur, const Cell* below, int n)
+{
+	uint64_t mask = 0;
+	for(int i = 0; i < n; ++i)
+		mask |= (uint64_t)(cur[i].id != EMPTY_PARTICLE && below[i].id == EMPTY_PARTICLE) << i;
+	return mask;
+}
+
+#ifdef FALL_KERNEL_X86
+__attribute__((target("sse2")))
+static uint64_t FallCandidatesSSE2(const Cell* cur, const Cell* below, int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	uint64_t mask = 0;
+	int i = 0;
+	for(; i + 16 <= n; i += 16){
+		__m128i c = _mm_loadu_si128((const __m128i*)(cur + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(below + i));
+		// below empty and not (cur empty)
+		__m128i fall = _mm_andnot_si128(_mm_cmpeq_epi8(c, zero), _mm_cmpeq_epi8(b, zero));
+		mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(fall) << i;
+	}
+	if(i < n)
+		mask |= FallCandidatesScalar(cur + i, below + i, n - i) << i;
+	return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t FallCandidatesAVX2(const Cell* cur, const Cell* below, int n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	uint64_t mask = 0;
+	int i = 0;
+	for(; i + 32 <= n; i += 32){
+		__m256i c = _mm256_loadu_si256((const __m256i*)(cur + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(below + i));
+		__m256i fall = _mm256_andnot_si256(_mm256_cmpeq_epi8(c, zero), _mm256_cmpeq_epi8(b, zero));
+		mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(fall) << i;
+	}
+	if(i < n)
+		mask |= FallCandidatesSSE2(cur + i, below + i, n - i) << i;
+	return mask;
+}
+#endif
+
+typedef uint64_t (*FallFn)(const Cell*, const Cell*, int);
+
+struct FallDispatch {
+	FallFn fn;
+	const char* name;
+
+	FallDispatch() {
+		fn = FallCandidatesScalar;
+		name = "scalar";
+#ifdef FALL_KERNEL_X86
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2")){
+			fn = FallCandidatesAVX2;
+			name = "avx2";
+		}else if(__builtin_cpu_supports("sse2")){
+			fn = FallCandidatesSSE2;
+			name = "sse2";
+		}
+#endif
+	}
+};
+
+static const FallDispatch& Dispatch()
+{
+	static FallDispatch dispatch;
+	return dispatch;
+}
+
+uint64_t FallCandidates(const Cell* cur, const Cell* below, int n)
+{
+	return Dispatch().fn(cur, below, n);
+}
+
+const char* FallKernelName()
+{
+	return Dispatch().name;
+}
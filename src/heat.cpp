@@ -0,0 +1,250 @@
+#include "particle_world.h"
+#include "replay_log.h"
+#include <algorithm>
+#include <cmath>
+
+// the heat field is plain Eulerian diffusion on a coarser float plane:
+// every heat step spreads heat to the four neighbours and leaks some to
+// ambient, then heat sources pull their heat cell towards their
+// temperature and cells past a threshold change phase. particles do not
+// carry heat with them when they move.
+
+// rows of heat cells per diffusion job
+#define HEAT_BAND_ROWS 32
+
+void ParticleWorld::EnableHeat(const HeatSettings& settings)
+{
+	if(recorder)
+		recorder->EnableHeat(settings);
+
+	heatSettings = settings;
+	heatSettings.interval = std::max(1, settings.interval);
+	heatSettings.diffusion = std::min(std::max(settings.diffusion, 0.0f), 0.25f);
+	heatShift = 0;
+	// stops at log2(CHUNK_SIZE) at the latest
+	while((2 << heatShift) <= std::min(settings.resolution, CHUNK_SIZE))
+		++heatShift;
+	heatSettings.resolution = 1 << heatShift;
+
+	heatWidth = (width + heatSettings.resolution - 1) >> heatShift;
+	heatHeight = (height + heatSettings.resolution - 1) >> heatShift;
+	heat.assign(heatWidth * heatHeight, heatSettings.ambient);
+	heatScratch.assign(heat.size(), heatSettings.ambient);
+	CompileHeatTables();
+}
+
+void ParticleWorld::DisableHeat()
+{
+	if(recorder)
+		recorder->DisableHeat();
+	std::vector<float>().swap(heat);
+	std::vector<float>().swap(heatScratch);
+	heatWidth = heatHeight = 0;
+}
+
+bool ParticleWorld::HeatEnabled() const
+{
+	return !heat.empty();
+}
+
+const HeatSettings& ParticleWorld::GetHeatSettings() const
+{
+	return heatSettings;
+}
+
+void ParticleWorld::SetParticleTemperature(std::string particle, float temperature)
+{
+	if(particleIDs.count(particle))
+		AddThermalRule(ThermalRule{THERMAL_SOURCE, particle, temperature, ""});
+}
+
+void ParticleWorld::SetPhaseChangeAbove(std::string particle, float temperature, std::string result)
+{
+	if(particleIDs.count(particle) && particleIDs.count(result))
+		AddThermalRule(ThermalRule{THERMAL_ABOVE, particle, temperature, result});
+}
+
+void ParticleWorld::SetPhaseChangeBelow(std::string particle, float temperature, std::string result)
+{
+	if(particleIDs.count(particle) && particleIDs.count(result))
+		AddThermalRule(ThermalRule{THERMAL_BELOW, particle, temperature, result});
+}
+
+const std::vector<ThermalRule>& ParticleWorld::GetThermalRules() const
+{
+	return thermalRules;
+}
+
+void ParticleWorld::AddThermalRule(const ThermalRule& rule)
+{
+	if(recorder)
+		recorder->AddThermalRule(rule);
+
+	// one rule of each kind per particle, the latest wins
+	auto same = std::find_if(thermalRules.begin(), thermalRules.end(), [&](const ThermalRule& r){
+		return r.kind == rule.kind && r.particle == rule.particle;
+	});
+	if(same != thermalRules.end())
+		*same = rule;
+	else
+		thermalRules.push_back(rule);
+	CompileHeatTables();
+}
+
+void ParticleWorld::CompileHeatTables()
+{
+	heatPull.assign(MAX_PARTICLE_TYPES, 0.0f);
+	heatSource.assign(MAX_PARTICLE_TYPES, 0.0f);
+	changeAbove.assign(MAX_PARTICLE_TYPES, INFINITY);
+	changeBelow.assign(MAX_PARTICLE_TYPES, -INFINITY);
+	changeAboveInto.assign(MAX_PARTICLE_TYPES, EMPTY_PARTICLE);
+	changeBelowInto.assign(MAX_PARTICLE_TYPES, EMPTY_PARTICLE);
+	heatActs.assign(MAX_PARTICLE_TYPES, 0);
+	// the rules changed, so every chunk needs a fresh look
+	for(Chunk& chunk : chunks)
+		chunk.heatIdle = false;
+
+	for(const ThermalRule& r : thermalRules){
+		auto particle = particleIDs.find(r.particle);
+		if(particle == particleIDs.end())
+			continue;
+		ParticleID id = particle->second;
+		auto result = particleIDs.find(r.result);
+
+		switch(r.kind){
+			case THERMAL_SOURCE:
+				heatPull[id] = heatSettings.coupling;
+				heatSource[id] = r.temperature;
+				heatActs[id] = 1;
+				break;
+			case THERMAL_ABOVE:
+				if(result == particleIDs.end())
+					break;
+				changeAbove[id] = r.temperature;
+				changeAboveInto[id] = result->second;
+				heatActs[id] = 1;
+				break;
+			case THERMAL_BELOW:
+				if(result == particleIDs.end())
+					break;
+				changeBelow[id] = r.temperature;
+				changeBelowInto[id] = result->second;
+				heatActs[id] = 1;
+				break;
+		}
+	}
+}
+
+void ParticleWorld::DiffuseHeatRows(size_t y0, size_t y1)
+{
+	const float k = heatSettings.diffusion;
+	const float cooling = heatSettings.cooling;
+	const float ambient = heatSettings.ambient;
+	const size_t w = heatWidth;
+
+	// the window edges reflect, so heat does not leak out of the grid; the
+	// interior of each row is a branch-free loop the compiler vectorizes
+	for(size_t y = y0; y < y1; ++y){
+		const float* __restrict up = &heat[(y > 0 ? y - 1 : y) * w];
+		const float* __restrict mid = &heat[y * w];
+		const float* __restrict down = &heat[(y + 1 < heatHeight ? y + 1 : y) * w];
+		float* __restrict out = &heatScratch[y * w];
+
+		if(w == 1){
+			out[0] = mid[0] + k * (up[0] + down[0] - 2.0f * mid[0]) + cooling * (ambient - mid[0]);
+			continue;
+		}
+		out[0] = mid[0] + k * (up[0] + down[0] + mid[1] - 3.0f * mid[0]) + cooling * (ambient - mid[0]);
+		for(size_t x = 1; x + 1 < w; ++x)
+			out[x] = mid[x] + k * (up[x] + down[x] + mid[x - 1] + mid[x + 1] - 4.0f * mid[x]) + cooling * (ambient - mid[x]);
+		out[w - 1] = mid[w - 1] + k * (up[w - 1] + down[w - 1] + mid[w - 2] - 3.0f * mid[w - 1]) + cooling * (ambient - mid[w - 1]);
+	}
+}
+
+void ParticleWorld::UpdateHeat()
+{
+	PROFILE_SCOPE(ZONE_HEAT);
+
+	size_t bands = (heatHeight + HEAT_BAND_ROWS - 1) / HEAT_BAND_ROWS;
+	auto job = [&](size_t b){ DiffuseHeatRows(b * HEAT_BAND_ROWS, std::min(heatHeight, (b + 1) * HEAT_BAND_ROWS)); };
+	if(pool)
+		pool->Run(bands, job);
+	else
+		for(size_t b = 0; b < bands; ++b)
+			job(b);
+	heat.swap(heatScratch);
+
+	// sources pull their heat cell, then anything past a threshold changes
+	// phase and wakes its chunk. a heat cell never spans two chunks, so the
+	// chunks run in parallel; ones holding nothing heat acts on are skipped
+	// until something in them changes
+	scheduled.clear();
+	for(size_t c = 0; c < chunks.size(); ++c)
+		if(!chunks[c].heatIdle)
+			scheduled.push_back(c);
+
+	auto chunkJob = [&](size_t i){ HeatChunk(scheduled[i]); };
+	if(pool)
+		pool->Run(scheduled.size(), chunkJob);
+	else
+		for(size_t i = 0; i < scheduled.size(); ++i)
+			chunkJob(i);
+
+	for(size_t c : scheduled){
+		Chunk& chunk = chunks[c];
+		MarkChanged(chunk.changed);
+		chunk.changed = CellRect{};
+	}
+}
+
+void ParticleWorld::HeatChunk(size_t c)
+{
+	Chunk& chunk = chunks[c];
+	CellRect bounds = ChunkBounds(c % chunkCols, c / chunkCols);
+	bool acts = false;
+	for(int y = bounds.y0; y < bounds.y1; ++y){
+		Cell* row = &cells[y * width];
+		float* heatRow = &heat[(y >> heatShift) * heatWidth];
+		for(int x = bounds.x0; x < bounds.x1; ++x){
+			ParticleID id = row[x].id;
+			if(!heatActs[id])
+				continue;
+			acts = true;
+			float& t = heatRow[x >> heatShift];
+			t += (heatSource[id] - t) * heatPull[id];
+
+			ParticleID into = t > changeAbove[id] ? changeAboveInto[id] : t < changeBelow[id] ? changeBelowInto[id] : id;
+			if(into == id)
+				continue;
+			row[x].id = into;
+			if(!velocity.empty())
+				velocity[y * width + x] = Velocity{};
+			chunk.changed.Add(x, y);
+		}
+	}
+	chunk.heatIdle = !acts;
+}
+
+float ParticleWorld::GetTemperature(Vector2 canvas) const
+{
+	int x = (int)floorf(canvas.x);
+	int y = (int)floorf(canvas.y);
+	if(heat.empty() || x < 0 || x >= (int)width || y < 0 || y >= (int)height)
+		return heatSettings.ambient;
+	return heat[(y >> heatShift) * heatWidth + (x >> heatShift)];
+}
+
+const float* ParticleWorld::GetHeat() const
+{
+	return heat.data();
+}
+
+size_t ParticleWorld::GetHeatWidth() const
+{
+	return heatWidth;
+}
+
+size_t ParticleWorld::GetHeatHeight() const
+{
+	return heatHeight;
+}
@@ -1,62 +1,144 @@
 #include "raylib.h"
+#include <cstring>
 #include "particle_system.h"
+#include "chunk_streamer.h"
+#include "replay_log.h"
+#include "sim_clock.h"
+#include "step_thread.h"
 
 #define WIDTH 800
 #define HEIGHT 600
 #define PIXEL_SIZE 15
+#define BRUSH_RADIUS 1.0f
+// resident window in chunks, enough to keep the screen covered while panning
+#define WINDOW_CHUNKS 3
+#define CACHED_CHUNKS 64
+#define PAN_SPEED 40.0f
+// simulation steps per second, independent of the display
+#define SIM_RATE 60.0
+#define MAX_SUBSTEPS 4
+#define CHECKPOINT_INTERVAL 60
 
-Vector2 ScreenToCanvas(Vector2 mousePos, Vector2 particleScale);
+// the build points this at the source tree; run from build/ otherwise
+#ifndef PHYSSIM_SHADER_DIR
+#define PHYSSIM_SHADER_DIR "../src"
+#endif
 
-int main()
+// everything that holds GPU resources lives in here, so it is gone before
+// the window and its context are
+static void Run(const char* recordPath)
 {
-    InitWindow(WIDTH, HEIGHT, "particle physics sim thing");
-	SetTargetFPS(GetMonitorRefreshRate(GetCurrentMonitor())/2.0f);
-	
-
-    ParticleSystem system({0,0,(float)WIDTH,(float)HEIGHT}, {PIXEL_SIZE, PIXEL_SIZE});
+	ReplayRecorder recorder;
+    ParticleSystem system(WINDOW_CHUNKS*CHUNK_SIZE, WINDOW_CHUNKS*CHUNK_SIZE, {PIXEL_SIZE, PIXEL_SIZE});
+	if(recordPath && recorder.Open(recordPath, system, CHECKPOINT_INTERVAL))
+		system.SetRecorder(&recorder);
     system.RegisterParticle(GenSolidParticle("STONE", GRAY, 0.6f));
     system.RegisterParticle(GenSolidParticle("OBSIDIAN", BLACK, 0.9f));
     system.RegisterParticle(GenFluidParticle("WATER", BLUE, 0.1));
     system.RegisterParticle(GenFluidParticle("LAVA", RED, 0.4));
     system.RegisterParticle(GenSolidParticle("SAND", BEIGE, 0.2));
     system.RegisterParticle(GenSolidParticle("MUD", BROWN, 0.3f));
+    system.RegisterParticle(GenParticle("STEAM", GAS, LIGHTGRAY, 0.05f));
 	system.SetParticleInteraction("SAND", "WATER", "MUD");
 	system.SetParticleInteraction("WATER", "LAVA", "OBSIDIAN");
 
-	system.AddShaderToParticle("SAND", "../src/noise.fs");
-	system.AddShaderToParticle("STONE", "../src/noise.fs");
-	system.AddShaderToParticle("MUD", "../src/noise.fs");
+	// lava heats its surroundings, water near it boils off and condenses again
+	system.EnableHeat(HeatSettings{});
+	system.SetParticleTemperature("LAVA", 1200.0f);
+	system.SetPhaseChangeAbove("WATER", 100.0f, "STEAM");
+	system.SetPhaseChangeBelow("STEAM", 60.0f, "WATER");
+	// falling sand and water speed up, and water splashes when it lands
+	system.EnableVelocity(VelocitySettings{});
+
+	system.UsePackedRenderer(PHYSSIM_SHADER_DIR "/material.fs");
+	system.SetParticleMaterial("SAND", MATERIAL_NOISE);
+	system.SetParticleMaterial("STONE", MATERIAL_NOISE);
+	system.SetParticleMaterial("MUD", MATERIAL_NOISE);
 	system.SetBackground(GenImageColor(WIDTH/PIXEL_SIZE, HEIGHT/PIXEL_SIZE, DARKBLUE));
 
+	// the arrow keys pan over a world larger than the window, chunks
+	// scrolled away are kept by the streamer
+	ChunkStreamer streamer(system, "chunks", CACHED_CHUNKS);
+	Vector2 camera = {0, 0};
+	Vector2 view = {(float)WIDTH/PIXEL_SIZE, (float)HEIGHT/PIXEL_SIZE};
+	streamer.Follow(Vector2{camera.x + view.x/2, camera.y + view.y/2});
+	system.FillRect(system.GetParticleID("STONE"), Rectangle{-system.GetOrigin().x, view.y - 1 - system.GetOrigin().y, view.x, 1});
+
+	// Update() runs on its own thread while the previous frame is drawn;
+	// the world is only touched here between Wait() and Start()
+	SimulationClock clock(SIM_RATE, MAX_SUBSTEPS);
+	StepThread stepper(system);
+	system.SetPipelined(true);
+
+	Vector2 lastMouse = system.ScreenToCanvas(GetMousePosition());
+	bool showProfiler = false;
 	while(!WindowShouldClose())
 	{
+		PROFILE_NEXT_FRAME();
+		stepper.Wait();
 		BeginDrawing();
 		ClearBackground(BLACK);
 
+		float pan = PAN_SPEED * GetFrameTime();
+		if(IsKeyDown(KEY_LEFT))  camera.x -= pan;
+		if(IsKeyDown(KEY_RIGHT)) camera.x += pan;
+		if(IsKeyDown(KEY_UP))    camera.y -= pan;
+		if(IsKeyDown(KEY_DOWN))  camera.y += pan;
+		system.SetCamera(camera);
+		Vector2 origin = system.GetOrigin();
+		streamer.Follow(Vector2{camera.x + view.x/2, camera.y + view.y/2});
+		// keep the stroke in world space across a window shift
+		lastMouse.x += origin.x - system.GetOrigin().x;
+		lastMouse.y += origin.y - system.GetOrigin().y;
+
+		// paint the whole stroke since last frame, not just the current cell
+		Vector2 mouse = system.ScreenToCanvas(GetMousePosition());
+		if(IsMouseButtonPressed(MOUSE_BUTTON_LEFT) || IsMouseButtonPressed(MOUSE_BUTTON_RIGHT) || IsMouseButtonPressed(MOUSE_BUTTON_MIDDLE))
+			lastMouse = mouse;
+
 		if(IsMouseButtonDown(MOUSE_BUTTON_LEFT))
-			system.InsertParticle("SAND", ScreenToCanvas(GetMousePosition(), (Vector2){PIXEL_SIZE, PIXEL_SIZE}));
+			system.FillLine(system.GetParticleID("SAND"), lastMouse, mouse, BRUSH_RADIUS);
 		if(IsMouseButtonDown(MOUSE_BUTTON_RIGHT) && IsKeyDown(KEY_LEFT_SHIFT))
-			system.InsertParticle("LAVA", ScreenToCanvas(GetMousePosition(), (Vector2){PIXEL_SIZE, PIXEL_SIZE}));
+			system.FillLine(system.GetParticleID("LAVA"), lastMouse, mouse, BRUSH_RADIUS);
 		else if(IsMouseButtonDown(MOUSE_BUTTON_RIGHT))
-			system.InsertParticle("WATER", ScreenToCanvas(GetMousePosition(), (Vector2){PIXEL_SIZE, PIXEL_SIZE}));
+			system.FillLine(system.GetParticleID("WATER"), lastMouse, mouse, BRUSH_RADIUS);
 		if(IsMouseButtonDown(MOUSE_BUTTON_MIDDLE))
-			system.InsertParticle("STONE", ScreenToCanvas(GetMousePosition(), (Vector2){PIXEL_SIZE, PIXEL_SIZE}));
+			system.FillLine(system.GetParticleID("STONE"), lastMouse, mouse, BRUSH_RADIUS);
+		lastMouse = mouse;
 
-		system.Update();
+		if(IsKeyPressed(KEY_F5))
+			system.SaveSnapshot("world.snap", true);
+		if(IsKeyPressed(KEY_F9))
+			system.LoadSnapshot("world.snap");
+		if(IsKeyPressed(KEY_F3))
+			showProfiler = !showProfiler;
+		if(IsKeyPressed(KEY_F4))
+			Profiler::Get().WriteChromeTrace("trace.json");
+
+		system.PublishFrame();
+		stepper.Start(clock.Advance(GetFrameTime()));
 		system.Render();
+		if(showProfiler)
+			system.DrawProfilerOverlay(WIDTH - 250, 10);
 
 		EndDrawing();
 	}
+	stepper.Wait();
+}
 
+// exec [--record session.rpl] logs the session for the replay tool
+int main(int argc, char** argv)
+{
+	const char* recordPath = nullptr;
+	for(int i = 1; i + 1 < argc; ++i)
+		if(!strcmp(argv[i], "--record"))
+			recordPath = argv[++i];
+
+    InitWindow(WIDTH, HEIGHT, "particle physics sim thing");
+	SetTargetFPS(GetMonitorRefreshRate(GetCurrentMonitor()));
+	Run(recordPath);
 
     CloseWindow();
     return 0;
 }
 
-Vector2 ScreenToCanvas(Vector2 mousePos, Vector2 particleScale){
-	Vector2 screen;
-	screen.x = mousePos.x / particleScale.x;
-	screen.y = mousePos.y / particleScale.y;
-	return screen;
-}
-
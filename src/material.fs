@@ -0,0 +1,90 @@
+#version 330
+
+precision highp float;
+
+uniform sampler2D texture0;  // particle IDs, one byte per cell
+uniform sampler2D u_palette; // row 0: colour per ID, row 1: material per ID
+uniform vec2 u_pixelScale;
+uniform float u_time;
+in vec2 fragTexCoord;
+out vec4 fragColor;
+
+#define MATERIAL_PLAIN     0
+#define MATERIAL_NOISE     1
+#define MATERIAL_HUE_SHIFT 2
+
+// ====== noise.fs ======
+float rand(vec2 co){
+    return fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453) * -1.2;
+}
+
+float noise(vec2 st){
+    vec2 i = floor(st);
+    vec2 f = fract(st);
+
+    float a = rand(i);
+    float b = rand(i + vec2(1.0,0.0));
+    float c = rand(i + vec2(0.0,1.0));
+    float d = rand(i + vec2(1.0,1.0));
+
+    vec2 u = f*f*(2.0-2.0*f);
+    return mix(a,b,u.x) + (c-a)*u.y*(1.0-u.x) + (d-b)*u.x*u.y;
+}
+
+// ====== water_hue.fs ======
+vec3 rgb2hsv(vec3 c){
+    float cmax = max(c.r, max(c.g, c.b));
+    float cmin = min(c.r, min(c.g, c.b));
+    float delta = cmax - cmin;
+
+    float h = 0.0;
+    if(delta > 0.0){
+        if(cmax == c.r) h = mod((c.g - c.b)/delta, 6.0);
+        else if(cmax == c.g) h = ((c.b - c.r)/delta + 2.0);
+        else h = ((c.r - c.g)/delta + 4.0);
+        h /= 6.0;
+        if(h < 0.0) h += 1.0;
+    }
+
+    float s = (cmax == 0.0) ? 0.0 : delta / cmax;
+    float v = cmax;
+    return vec3(h,s,v);
+}
+
+vec3 hsv2rgb(vec3 c){
+    float h = c.x * 6.0;
+    float s = c.y;
+    float v = c.z;
+
+    float i = floor(h);
+    float f = h - i;
+    float p = v * (1.0 - s);
+    float q = v * (1.0 - s*f);
+    float t = v * (1.0 - s*(1.0 - f));
+
+    if(i == 0.0) return vec3(v,t,p);
+    else if(i == 1.0) return vec3(q,v,p);
+    else if(i == 2.0) return vec3(p,v,t);
+    else if(i == 3.0) return vec3(p,q,v);
+    else if(i == 4.0) return vec3(t,p,v);
+    else return vec3(v,p,q);
+}
+
+void main()
+{
+    int id = int(texture(texture0, fragTexCoord).r * 255.0 + 0.5);
+    vec4 color = texelFetch(u_palette, ivec2(id, 0), 0);
+    int material = int(texelFetch(u_palette, ivec2(id, 1), 0).r * 255.0 + 0.5);
+
+    if(material == MATERIAL_NOISE){
+        vec2 noiseCoord = fragTexCoord * u_pixelScale * 8.0;
+        color.rg += (noise(noiseCoord) - 0.5) * 0.1;
+    }
+    else if(material == MATERIAL_HUE_SHIFT){
+        vec3 hsv = rgb2hsv(color.rgb);
+        hsv.x = fract(hsv.x + u_time * 0.05);
+        color.rgb = hsv2rgb(hsv);
+    }
+
+    fragColor = color;
+}
@@ -1,70 +1,75 @@
 #include "particle_system.h"
 #include <vector>
-#include <bits/stdc++.h>
 #include <algorithm>
 #include <cstring>
 #include "raylib.h"
-#include <random>
 
-static std::mt19937 rng{ std::random_device{}() };
-Particle* GenSolidParticle(std::string name, Color clr, float density) {
-    return new Particle{name, SOLID, clr, density};
-}
-
-Particle* GenFluidParticle(std::string name, Color clr, float density) {
-    return new Particle{name, FLUID, clr, density};
-}
-
-Particle* GenParticle(std::string name, PARTICLE_TYPE type, Color clr, float density){
-    return new Particle{name, type, clr, density};
+ParticleSystem::ParticleSystem(Rectangle screen, Vector2 scale)
+	: ParticleSystem((size_t)(screen.width / scale.x), (size_t)(screen.height / scale.y), scale)
+{
 }
 
-ParticleSystem::ParticleSystem(Rectangle screen, Vector2 scale) {
+ParticleSystem::ParticleSystem(size_t width, size_t height, Vector2 scale)
+	: ParticleWorld(width, height)
+{
     this->particleScale = scale;
-    this->width  = (size_t)(screen.width  / scale.x);
-    this->height = (size_t)(screen.height / scale.y);
+	camera = Vector2{0, 0};
 
-    particles = new Particle*[width * height];
-    for(size_t i = 0; i < width * height; ++i) 
-		particles[i] = nullptr;
-
-    particleTypes.clear();
+	// GPU resources are created by the first Render()
+	renderMode = RENDER_PER_TYPE;
     particleBuffers.clear();
     particleTextures.clear();
     particleShaders.clear();
+	idTexture.id = 0;
+	paletteTexture.id = 0;
+	materialShader.id = 0;
+	pipelined = false;
 
     background.id = 0;
 }
 
 ParticleSystem::~ParticleSystem(){
-	delete[] particles;
-}
-
-void ParticleSystem::RegisterParticle(Particle* prototype)
-{
-    const std::string& name = prototype->parent;
-
-    particleTypes[name] = prototype;
-
-    Color* buf = new Color[width * height];
-    for(size_t i = 0; i < width * height; ++i) 
-		buf[i] = BLANK;
-    particleBuffers[name] = buf;
-
-    Image temp = GenImageColor(width, height, BLANK);
-    particleTextures[name] = LoadTextureFromImage(temp);
-    UnloadImage(temp);
+	// GPU objects go away with the GL context, and unloading them after
+	// CloseWindow() would call into a dead one
+	if(!IsWindowReady())
+		return;
+	UnloadRenderResources();
+	for(auto& shader : particleShaders)
+		UnloadShader(shader.second);
+	if(materialShader.id > 0) UnloadShader(materialShader);
+	if(background.id > 0) UnloadTexture(background);
 }
 
 void ParticleSystem::AddShaderToParticle(std::string typeName, std::string shaderFilePath)
 {
     Shader s = LoadShader(0, shaderFilePath.c_str());
+	auto old = particleShaders.find(typeName);
+	if(old != particleShaders.end())
+		UnloadShader(old->second);
     particleShaders[typeName] = s;
 
     int loc = GetShaderLocation(s, "u_pixelScale");
     if(loc >= 0) SetShaderValue(s, loc, &particleScale, SHADER_UNIFORM_VEC2);
 }
 
+void ParticleSystem::SetParticleMaterial(std::string typeName, PARTICLE_MATERIAL material)
+{
+	particleMaterials[typeName] = material;
+}
+
+void ParticleSystem::UsePackedRenderer(std::string materialShaderPath)
+{
+	UnloadRenderResources();
+	renderMode = RENDER_PACKED;
+
+	if(materialShader.id > 0) UnloadShader(materialShader);
+	materialShader = LoadShader(0, materialShaderPath.c_str());
+	int loc = GetShaderLocation(materialShader, "u_pixelScale");
+	if(loc >= 0) SetShaderValue(materialShader, loc, &particleScale, SHADER_UNIFORM_VEC2);
+
+	RefreshAll();
+}
+
 void ParticleSystem::UpdateShaderF(std::string shaderPath, std::string uniformName, float value)
 {
     auto it = particleShaders.find(shaderPath);
@@ -110,51 +115,203 @@ void ParticleSystem::UpdateShaderV4(std::string shaderPath, std::string uniformN
     }
 }
 
-void ParticleSystem::SetParticleInteraction(std::string particleOne, std::string particleTwo, std::string particleResult){
-	if(particleTypes.count(particleOne) && particleTypes.count(particleTwo) && particleTypes.count(particleResult))
-		particleInteractions[make_key(particleOne,particleTwo)] = particleResult;
+void ParticleSystem::SyncRenderResources()
+{
+	if(renderMode == RENDER_PACKED){
+		if(idTexture.id == 0){
+			Image ids = { (void*)RenderCells(), (int)width, (int)height, 1, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE };
+			idTexture = LoadTextureFromImage(ids);
+			Image temp = GenImageColor(MAX_PARTICLE_TYPES, 2, BLANK);
+			paletteTexture = LoadTextureFromImage(temp);
+			UnloadImage(temp);
+			palette.assign(MAX_PARTICLE_TYPES * 2, BLANK);
+		}
+
+		// row 0 holds colours, row 1 holds the material in red
+		Color next[MAX_PARTICLE_TYPES * 2] = {};
+		for(size_t id = 1; id < particleRegistry.size(); ++id){
+			next[id] = particleRegistry[id].clr;
+			auto it = particleMaterials.find(particleRegistry[id].parent);
+			next[MAX_PARTICLE_TYPES + id].r = it != particleMaterials.end() ? (unsigned char)it->second : (unsigned char)MATERIAL_PLAIN;
+		}
+		if(memcmp(next, palette.data(), sizeof(next)) != 0){
+			std::copy_n(next, MAX_PARTICLE_TYPES * 2, palette.begin());
+			UpdateTexture(paletteTexture, palette.data());
+		}
+		return;
+	}
+
+	if(particleTextures.size() == particleRegistry.size())
+		return;
+	// a loaded snapshot can bring fewer types than we have textures for
+	while(particleTextures.size() > std::max<size_t>(particleRegistry.size(), 1)){
+		UnloadTexture(particleTextures.back());
+		particleTextures.pop_back();
+		particleBuffers.pop_back();
+	}
+	if(particleTextures.empty()){
+		particleBuffers.emplace_back();
+		particleTextures.push_back(Texture2D{});
+	}
+	while(particleTextures.size() < particleRegistry.size()){
+		particleBuffers.emplace_back(width * height, BLANK);
+		Image temp = GenImageColor(width, height, BLANK);
+		particleTextures.push_back(LoadTextureFromImage(temp));
+		UnloadImage(temp);
+	}
+	RefreshAll();
+}
+
+void ParticleSystem::UnloadRenderResources()
+{
+	for(size_t id = 1; id < particleTextures.size(); ++id)
+		UnloadTexture(particleTextures[id]);
+	particleTextures.clear();
+	particleBuffers.clear();
+
+	if(idTexture.id > 0) UnloadTexture(idTexture);
+	if(paletteTexture.id > 0) UnloadTexture(paletteTexture);
+	idTexture.id = 0;
+	paletteTexture.id = 0;
+	palette.clear();
 }
 
-void ParticleSystem::InsertParticle(std::string typeName, Vector2 canvas)
+const Cell* ParticleSystem::RenderCells() const
 {
-    int x = (int)canvas.x;
-    int y = (int)canvas.y;
+	return pipelined ? renderCells.data() : cells.data();
+}
 
-    if(x < 0 || x >= (int)width || y < 0 || y >= (int)height) 
+void ParticleSystem::CollectDirty(std::vector<CellRect>& out)
+{
+	if(renderMode == RENDER_PACKED){
+		// the grid already is the ID texture, so only work out which
+		// full-width row bands need re-uploading
+		for(size_t cy = 0; cy < chunkRows; ++cy){
+			CellRect band;
+			for(size_t cx = 0; cx < chunkCols; ++cx){
+				Chunk& chunk = chunks[cy * chunkCols + cx];
+				band.Merge(chunk.dirty);
+				chunk.dirty = CellRect{};
+			}
+			if(band.Empty())
+				continue;
+			band.x0 = 0;
+			band.x1 = (int)width;
+			if(!out.empty() && out.back().y1 >= band.y0 && out.back().y0 <= band.y1)
+				out.back().Merge(band);
+			else
+				out.push_back(band);
+		}
 		return;
+	}
+
+	for(Chunk& chunk : chunks){
+		if(chunk.dirty.Empty())
+			continue;
+		out.push_back(chunk.dirty);
+		chunk.dirty = CellRect{};
+	}
+}
+
+void ParticleSystem::RefreshAll()
+{
+	if(pipelined)
+		publishedRects.push_back(CellRect{0, 0, (int)width, (int)height});
+	else
+		MarkAllDirty();
+}
 
-    int index = y * width + x;
-    Particle* proto = particleTypes[typeName];
-    Particle* newParticle = nullptr;
+void ParticleSystem::SetPipelined(bool pipelined)
+{
+	if(pipelined && !this->pipelined){
+		renderCells = cells;
+		publishedRects.clear();
+		// whatever was dirty is in the copy now
+		MarkAllDirty();
+		CollectDirty(publishedRects);
+	}
+	this->pipelined = pipelined;
+}
 
-	newParticle = new Particle{proto->parent, proto->type, proto->clr, proto->density};
-    particles[index] = newParticle;
+void ParticleSystem::PublishFrame()
+{
+	if(!pipelined)
+		return;
+	PROFILE_SCOPE(ZONE_PUBLISH);
+
+	size_t first = publishedRects.size();
+	CollectDirty(publishedRects);
+	for(size_t i = first; i < publishedRects.size(); ++i){
+		const CellRect& r = publishedRects[i];
+		for(int y = r.y0; y < r.y1; ++y)
+			std::copy_n(cells.begin() + y*width + r.x0, r.x1 - r.x0, renderCells.begin() + y*width + r.x0);
+	}
 }
 
 void ParticleSystem::UpdateColors() {
-    for(auto& [name, buf] : particleBuffers){
-        for(size_t i = 0; i < width*height; ++i)
-            buf[i] = BLANK;
+	PROFILE_SCOPE(ZONE_UPDATE_COLORS);
+	SyncRenderResources();
+
+	// pipelined, PublishFrame() already took the dirty rects and the chunks
+	// may be in use by Update() right now
+	if(!pipelined)
+		CollectDirty(publishedRects);
+
+	if(renderMode == RENDER_PACKED){
+		uploadRects.insert(uploadRects.end(), publishedRects.begin(), publishedRects.end());
+		publishedRects.clear();
+		return;
 	}
 
-    for(size_t y=0; y<height; ++y){
-        for(size_t x=0; x<width; ++x){
-            int i = y*width + x;
-            Particle* p = particles[i];
-            if(!p) continue;
-            particleBuffers[p->parent][i] = p->clr;
-        }
-    }
+	// only rebuild what changed since the last upload
+	const Cell* source = RenderCells();
+	for(const CellRect& r : publishedRects){
+		for(size_t id = 1; id < particleBuffers.size(); ++id)
+			for(int y = r.y0; y < r.y1; ++y)
+				std::fill_n(particleBuffers[id].begin() + y*width + r.x0, r.x1 - r.x0, BLANK);
+
+		for(int y = r.y0; y < r.y1; ++y){
+			for(int x = r.x0; x < r.x1; ++x){
+				int i = y*width + x;
+				ParticleID id = source[i].id;
+				if(id == EMPTY_PARTICLE) continue;
+				particleBuffers[id][i] = particleRegistry[id].clr;
+			}
+		}
+
+		uploadRects.push_back(r);
+	}
+	publishedRects.clear();
 }
 
 void ParticleSystem::UpdateTextures() {
-    for(auto& [name, buf] : particleBuffers)
-        UpdateTexture(particleTextures[name], buf);
+	PROFILE_SCOPE(ZONE_UPDATE_TEXTURES);
+	for(const CellRect& r : uploadRects){
+		int w = r.x1 - r.x0;
+		int h = r.y1 - r.y0;
+
+		if(renderMode == RENDER_PACKED){
+			UpdateTextureRec(idTexture, Rectangle{0, (float)r.y0, (float)width, (float)h}, (void*)(RenderCells() + r.y0*width));
+			continue;
+		}
+
+		uploadScratch.resize((size_t)w * h);
+		for(size_t id = 1; id < particleTextures.size(); ++id){
+			for(int y = 0; y < h; ++y)
+				std::copy_n(particleBuffers[id].begin() + (r.y0 + y)*width + r.x0, w, uploadScratch.begin() + y*w);
+			UpdateTextureRec(particleTextures[id], Rectangle{(float)r.x0, (float)r.y0, (float)w, (float)h}, uploadScratch.data());
+		}
+	}
+	uploadRects.clear();
 }
 
-void ParticleSystem::Render() {
-    UpdateColors();
-    UpdateTextures();
+void ParticleSystem::DrawGrid()
+{
+	PROFILE_SCOPE(ZONE_DRAW);
+	// the grid sits wherever its window is in the world
+	Vector2 origin = GetOrigin();
+	Rectangle dest = {(origin.x - camera.x) * particleScale.x, (origin.y - camera.y) * particleScale.y,
+					  (float)width * particleScale.x, (float)height * particleScale.y};
 
     if(background.id > 0)
             DrawTexturePro(
@@ -164,14 +321,30 @@ void ParticleSystem::Render() {
                 Vector2{0,0}, 0.0f, WHITE
             );
 
-    for(auto& [name, tex] : particleTextures){
-        auto it = particleShaders.find(name);
+	if(renderMode == RENDER_PACKED){
+		BeginShaderMode(materialShader);
+		SetShaderValueTexture(materialShader, GetShaderLocation(materialShader, "u_palette"), paletteTexture);
+		float time = (float)GetTime();
+		int loc = GetShaderLocation(materialShader, "u_time");
+		if(loc >= 0) SetShaderValue(materialShader, loc, &time, SHADER_UNIFORM_FLOAT);
+		DrawTexturePro(
+			idTexture,
+			Rectangle{0,0,(float)idTexture.width,(float)idTexture.height},
+			dest,
+			Vector2{0,0}, 0.0f, WHITE
+		);
+		EndShaderMode();
+	}
+
+    for(size_t id = 1; id < particleTextures.size(); ++id){
+		const Texture2D& tex = particleTextures[id];
+        auto it = particleShaders.find(particleRegistry[id].parent);
         if(it != particleShaders.end()){
             BeginShaderMode(it->second);
             DrawTexturePro(
                 tex,
                 Rectangle{0,0,(float)tex.width,(float)tex.height},
-                Rectangle{0,0,(float)GetScreenWidth(),(float)GetScreenHeight()},
+                dest,
                 Vector2{0,0}, 0.0f, WHITE
             );
             EndShaderMode();
@@ -180,22 +353,62 @@ void ParticleSystem::Render() {
             DrawTexturePro(
                 tex,
                 Rectangle{0,0,(float)tex.width,(float)tex.height},
-                Rectangle{0,0,(float)GetScreenWidth(),(float)GetScreenHeight()},
+                dest,
                 Vector2{0,0}, 0.0f, WHITE
             );
         }
     }
+}
+
+void ParticleSystem::Render() {
+    UpdateColors();
+    UpdateTextures();
+
+	DrawGrid();
+
+	PROFILE_SCOPE(ZONE_DEBUG_TEXT);
 	int y = 0;
-	for(auto k : particleInteractions){
-		DrawText(TextFormat("%s + %s = %s", k.first.first.c_str(), k.first.second.c_str(), k.second.c_str()), 20, 20+(30*y), 20, BLACK);
+	for(const InteractionRule& r : interactionRules){
+		DrawText(TextFormat("%s + %s = %s",
+					r.typeOne != NONE ? ParticleTypeName(r.typeOne) : r.particleOne.c_str(),
+					r.typeTwo != NONE ? ParticleTypeName(r.typeTwo) : r.particleTwo.c_str(),
+					r.result.c_str()), 20, 20+(30*y), 20, BLACK);
 		y++;
 	}
 }
 
+void ParticleSystem::DrawProfilerOverlay(int x, int y)
+{
+	const ProfileFrame& frame = Profiler::Get().LastFrame();
+	DrawRectangle(x, y, 240, 14 * (ZONE_COUNT + COUNTER_COUNT + 1) + 8, Fade(BLACK, 0.6f));
+	y += 4;
+#ifndef PHYSSIM_PROFILE
+	DrawText("built without PHYSSIM_PROFILE", x + 4, y, 10, RAYWHITE);
+	y += 14;
+#endif
+	DrawText(TextFormat("frame %llu", (unsigned long long)frame.index), x + 4, y, 10, RAYWHITE);
+	y += 14;
+	for(int z = 0; z < ZONE_COUNT; ++z, y += 14)
+		DrawText(TextFormat("%-16s %7.3f ms", Profiler::ZoneName((PROFILE_ZONE)z), frame.zoneMs[z]), x + 4, y, 10, RAYWHITE);
+	for(int c = 0; c < COUNTER_COUNT; ++c, y += 14)
+		DrawText(TextFormat("%-16s %llu", Profiler::CounterName((PROFILE_COUNTER)c), (unsigned long long)frame.counters[c]), x + 4, y, 10, RAYWHITE);
+}
+
+void ParticleSystem::SetCamera(Vector2 camera)
+{
+	this->camera = camera;
+}
+
+Vector2 ParticleSystem::GetCamera() const
+{
+	return camera;
+}
+
 Vector2 ParticleSystem::ScreenToCanvas(Vector2 mousePos){
+	Vector2 origin = GetOrigin();
     Vector2 canvas;
-    canvas.x = mousePos.x / particleScale.x;
-    canvas.y = mousePos.y / particleScale.y;
+    canvas.x = mousePos.x / particleScale.x + camera.x - origin.x;
+    canvas.y = mousePos.y / particleScale.y + camera.y - origin.y;
     return canvas;
 }
 
@@ -205,148 +418,3 @@ void ParticleSystem::SetBackground(Image img)
     background = LoadTextureFromImage(img);
     UnloadImage(img);
 }
-
-
-void ParticleSystem::Update() {
-	std::vector<int> xs(width);
-	std::iota(xs.begin(), xs.end(), 0);
-	std::shuffle(xs.begin(), xs.end(), rng);
-
-    for(int y = (int)height-2; y >= 0; --y){
-        for(int xi = 0; xi < (int)width; ++xi){
-			int x = xs[xi];
-            int curr = y*width + x;
-			int top = (y-1)*width + x;
-            int bottom = (y+1)*width + x;
-            int botLeft = (y+1)*width + x-1;
-            int botRight = (y+1)*width + x+1;
-            int left = y*width + x-1;
-            int right = y*width + x+1;
-
-            Particle* pCurr = particles[curr];
-
-			if(!pCurr)
-				continue;
-
-			if(pCurr->type == SOLID){
-				if(y < height-1){ // bottom
-					if(!particles[bottom]){
-							std::swap(particles[curr], particles[bottom]); 
-						continue;
-					}else if(particles[bottom]){
-						if(particleInteractions.count(make_key(particles[curr]->parent, particles[bottom]->parent))){
-							std::string result = particleInteractions[make_key(particles[curr]->parent, particles[bottom]->parent)];
-							particles[bottom] = GenParticle(result, particleTypes[result]->type, particleTypes[result]->clr, particleTypes[result]->density);
-							delete particles[curr];
-							particles[curr] = nullptr;
-							continue;
-						}else{
-							if(particles[bottom]->type == FLUID){
-								if ((float)rand() / RAND_MAX < particles[curr]->density - particles[bottom]->density)
-									std::swap(particles[curr], particles[bottom]);
-							}
-						}
-					}
-				}if(x < width-1 && y < height-1){
-					if(!particles[botRight]){
-						if ((float)rand() / RAND_MAX < (particles[curr]->density))
-							std::swap(particles[curr], particles[botRight]); 
-						continue;
-					}else if(particles[botRight]){
-						if(particleInteractions.count(make_key(particles[curr]->parent, particles[botRight]->parent))){
-							std::string result = particleInteractions[make_key(particles[curr]->parent, particles[botRight]->parent)];
-							particles[botRight] = GenParticle(result, particleTypes[result]->type, particleTypes[result]->clr, particleTypes[result]->density);
-							delete particles[curr];
-							particles[curr] = nullptr;
-							continue;
-						}else{
-							if(particles[botRight]->type == FLUID){
-								if ((float)rand() / RAND_MAX < particles[curr]->density - particles[botRight]->density)
-									std::swap(particles[curr], particles[botRight]);
-							}
-						}
-					}
-				}if(x > 0){
-					if(!particles[botLeft]){
-						if ((float)rand() / RAND_MAX < (particles[curr]->density))
-							std::swap(particles[curr], particles[botLeft]);
-						continue;
-					}else if(particles[botLeft]){
-						if(particleInteractions.count(make_key(particles[curr]->parent, particles[botLeft]->parent))){
-							std::string result = particleInteractions[make_key(particles[curr]->parent, particles[botLeft]->parent)];
-							particles[botLeft] = GenParticle(result, particleTypes[result]->type, particleTypes[result]->clr, particleTypes[result]->density);
-							delete particles[curr];
-							particles[curr] = nullptr;
-							continue;
-						}else{
-							if(particles[botLeft]->type == FLUID){
-								if ((float)rand() / RAND_MAX < particles[curr]->density - particles[botLeft]->density)
-									std::swap(particles[curr], particles[botLeft]);
-							}
-						}
-					}
-				}
-			}else if(pCurr->type == FLUID){
-				if(y < height-1){ // bottom
-					if(!particles[bottom]){
-						std::swap(particles[curr], particles[bottom]); continue;
-					}else if(particles[bottom]){
-						if(particleInteractions.count(make_key(particles[curr]->parent, particles[bottom]->parent))){
-							std::string result = particleInteractions[make_key(particles[curr]->parent, particles[bottom]->parent)];
-							particles[bottom] = GenParticle(result, particleTypes[result]->type, particleTypes[result]->clr, particleTypes[result]->density);
-							delete particles[curr];
-							particles[curr] = nullptr;
-							continue;
-						}else{
-							if(particles[bottom]->type == FLUID){
-								if ((float)rand() / RAND_MAX < particles[curr]->density - particles[bottom]->density)
-									std::swap(particles[curr], particles[bottom]);
-							}
-						}
-					}
-				}if(x < width-1 && y < height-1){
-					if(!particles[right]){
-						std::swap(particles[curr], particles[right]); continue;
-					}else if(particles[right]){
-						if(particleInteractions.count(make_key(particles[curr]->parent, particles[right]->parent))){
-							std::string result = particleInteractions[make_key(particles[curr]->parent, particles[right]->parent)];
-							particles[right] = GenParticle(result, particleTypes[result]->type, particleTypes[result]->clr, particleTypes[result]->density);
-							delete particles[curr];
-							particles[curr] = nullptr;
-							continue;
-						}else{
-							if(particles[right]->type == FLUID){
-								if ((float)rand() / RAND_MAX < particles[curr]->density - particles[right]->density)
-									std::swap(particles[curr], particles[right]);
-							}
-						}
-					}
-				}if(x > 0){
-					if(!particles[left]){
-						std::swap(particles[curr], particles[left]); continue;
-					}else if(particles[left]){
-						if(particleInteractions.count(make_key(particles[curr]->parent, particles[left]->parent))){
-							std::string result = particleInteractions[make_key(particles[curr]->parent, particles[left]->parent)];
-							particles[left] = GenParticle(result, particleTypes[result]->type, particleTypes[result]->clr, particleTypes[result]->density);
-							delete particles[curr];
-							particles[curr] = nullptr;
-							continue;
-						}else{
-							if(particles[left]->type == FLUID){
-								if ((float)rand() / RAND_MAX < particles[curr]->density - particles[left]->density)
-									std::swap(particles[curr], particles[left]);
-							}
-						}
-					}
-				}
-			}
-        }
-    }
-}
-
-std::pair<std::string, std::string> make_key(const std::string& a, const std::string& b) {
-    if (a < b)
-        return {a, b};
-    else
-        return {b, a};
-}
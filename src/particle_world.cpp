@@ -0,0 +1,785 @@
+#include "particle_world.h"
+#include "move_rules.h"
+#include "fall_kernel.h"
+#include "chunk_codec.h"
+#include "replay_log.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+Particle GenSolidParticle(std::string name, Color clr, float density) {
+    return Particle{name, SOLID, clr, density};
+}
+
+Particle GenFluidParticle(std::string name, Color clr, float density) {
+    return Particle{name, FLUID, clr, density};
+}
+
+Particle GenParticle(std::string name, PARTICLE_TYPE type, Color clr, float density){
+    return Particle{name, type, clr, density};
+}
+
+const char* ParticleTypeName(PARTICLE_TYPE type){
+	switch(type){
+		case STATIC: return "STATIC";
+		case SOLID:  return "SOLID";
+		case FLUID:  return "FLUID";
+		case GAS:    return "GAS";
+		default:     return "NONE";
+	}
+}
+
+void CellRect::Add(int x, int y)
+{
+	if(Empty()){
+		x0 = x; y0 = y; x1 = x + 1; y1 = y + 1;
+		return;
+	}
+	x0 = std::min(x0, x);
+	y0 = std::min(y0, y);
+	x1 = std::max(x1, x + 1);
+	y1 = std::max(y1, y + 1);
+}
+
+void CellRect::Merge(const CellRect& other)
+{
+	if(other.Empty())
+		return;
+	if(Empty()){
+		*this = other;
+		return;
+	}
+	x0 = std::min(x0, other.x0);
+	y0 = std::min(y0, other.y0);
+	x1 = std::max(x1, other.x1);
+	y1 = std::max(y1, other.y1);
+}
+
+CellRect CellRect::Intersect(const CellRect& other) const
+{
+	return CellRect{std::max(x0, other.x0), std::max(y0, other.y0),
+					std::min(x1, other.x1), std::min(y1, other.y1)};
+}
+
+ParticleWorld::ParticleWorld(size_t width, size_t height) {
+    this->width  = width;
+    this->height = height;
+
+    cells.assign(width * height, Cell{});
+
+	chunkCols = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunkRows = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunks.assign(chunkCols * chunkRows, Chunk{});
+	for(size_t cy = 0; cy < chunkRows; ++cy)
+		for(size_t cx = 0; cx < chunkCols; ++cx)
+			phaseChunks[(cx & 1) | ((cy & 1) << 1)].push_back(cy * chunkCols + cx);
+	MarkChanged(CellRect{0, 0, (int)width, (int)height});
+
+	seed = DEFAULT_SEED;
+	frame = 0;
+	recorder = nullptr;
+	moveStamps.assign(width * height, 0);
+	stampTag = 0;
+	originChunkX = 0;
+	originChunkY = 0;
+	heatWidth = heatHeight = 0;
+	heatShift = 0;
+	gravityStep = speedCap = dragStep = splashShare = 0;
+	kernel = KERNEL_SCALAR;
+
+	// slot 0 is the empty cell, so a zeroed grid is an empty grid
+	particleRegistry.clear();
+	particleRegistry.push_back(Particle{"", NONE, BLANK, 0.0f});
+	particleIDs.clear();
+	interactionRules.clear();
+	CompileInteractions();
+	CompileMoveTables();
+	CompileHeatTables();
+}
+
+ParticleWorld::~ParticleWorld(){
+}
+
+size_t ParticleWorld::GetWidth() const
+{
+	return width;
+}
+
+size_t ParticleWorld::GetHeight() const
+{
+	return height;
+}
+
+const Cell* ParticleWorld::GetCells() const
+{
+	return cells.data();
+}
+
+ParticleID ParticleWorld::GetParticleID(const std::string& typeName) const
+{
+	auto it = particleIDs.find(typeName);
+	return it != particleIDs.end() ? it->second : EMPTY_PARTICLE;
+}
+
+const Particle& ParticleWorld::GetParticle(ParticleID id) const
+{
+	return particleRegistry[id];
+}
+
+size_t ParticleWorld::GetParticleTypeCount() const
+{
+	return particleRegistry.size();
+}
+
+const std::vector<InteractionRule>& ParticleWorld::GetInteractionRules() const
+{
+	return interactionRules;
+}
+
+void ParticleWorld::RegisterParticle(const Particle& prototype)
+{
+    const std::string& name = prototype.parent;
+	if(recorder)
+		recorder->RegisterParticle(prototype);
+
+	auto it = particleIDs.find(name);
+	if(it != particleIDs.end()){
+		particleRegistry[it->second] = prototype;
+		CompileInteractions();
+		CompileMoveTables();
+		CompileHeatTables();
+		MarkChanged(CellRect{0, 0, (int)width, (int)height});
+		return;
+	}
+	if(particleRegistry.size() >= MAX_PARTICLE_TYPES)
+		return;
+
+	ParticleID id = (ParticleID)particleRegistry.size();
+	particleIDs[name] = id;
+	particleRegistry.push_back(prototype);
+
+	CompileInteractions();
+	CompileMoveTables();
+	CompileHeatTables();
+}
+
+void ParticleWorld::CompileMoveTables()
+{
+	fallsStraight.assign(MAX_PARTICLE_TYPES, 0);
+	for(size_t id = 1; id < particleRegistry.size(); ++id){
+		PARTICLE_TYPE type = particleRegistry[id].type;
+		fallsStraight[id] = (type == SOLID && FallsStraight<SOLID>()) ||
+							(type == FLUID && FallsStraight<FLUID>()) ||
+							(type == GAS && FallsStraight<GAS>());
+	}
+}
+
+void ParticleWorld::SetParticleInteraction(std::string particleOne, std::string particleTwo, std::string particleResult){
+	if(particleIDs.count(particleOne) && particleIDs.count(particleTwo) && particleIDs.count(particleResult))
+		AddInteractionRule(InteractionRule{NONE, particleOne, NONE, particleTwo, particleResult});
+}
+
+void ParticleWorld::InteractionTypeToType(PARTICLE_TYPE typeOne, PARTICLE_TYPE typeTwo, std::string particleResult){
+	if(typeOne != NONE && typeTwo != NONE && particleIDs.count(particleResult))
+		AddInteractionRule(InteractionRule{typeOne, "", typeTwo, "", particleResult});
+}
+
+void ParticleWorld::InteractionTypeToParticle(PARTICLE_TYPE type, std::string particle, std::string particleResult){
+	if(type != NONE && particleIDs.count(particle) && particleIDs.count(particleResult))
+		AddInteractionRule(InteractionRule{type, "", NONE, particle, particleResult});
+}
+
+static bool RuleSideMatches(PARTICLE_TYPE type, const std::string& name, const Particle& p){
+	return type != NONE ? p.type == type : p.parent == name;
+}
+
+static bool SameRuleSide(PARTICLE_TYPE typeA, const std::string& nameA, PARTICLE_TYPE typeB, const std::string& nameB){
+	return typeA == typeB && (typeA != NONE || nameA == nameB);
+}
+
+void ParticleWorld::AddInteractionRule(const InteractionRule& rule)
+{
+	if(recorder)
+		recorder->AddInteractionRule(rule);
+
+	// a rule over the same pair of sides replaces the old one
+	for(InteractionRule& r : interactionRules){
+		bool same = (SameRuleSide(r.typeOne, r.particleOne, rule.typeOne, rule.particleOne) &&
+					 SameRuleSide(r.typeTwo, r.particleTwo, rule.typeTwo, rule.particleTwo)) ||
+					(SameRuleSide(r.typeOne, r.particleOne, rule.typeTwo, rule.particleTwo) &&
+					 SameRuleSide(r.typeTwo, r.particleTwo, rule.typeOne, rule.particleOne));
+		if(same){
+			r = rule;
+			CompileInteractions();
+			return;
+		}
+	}
+	interactionRules.push_back(rule);
+	CompileInteractions();
+}
+
+void ParticleWorld::CompileInteractions()
+{
+	size_t n = particleRegistry.size();
+	reactionStride = n;
+	reactionTable.assign(n * n, EMPTY_PARTICLE);
+
+	// particle rules beat type-to-particle rules, which beat type-to-type
+	// rules; among equally specific rules the latest one wins
+	std::vector<int> specificity(n * n, -1);
+	for(const InteractionRule& r : interactionRules){
+		auto result = particleIDs.find(r.result);
+		if(result == particleIDs.end())
+			continue;
+		int spec = (r.typeOne == NONE) + (r.typeTwo == NONE);
+
+		for(size_t a = 1; a < n; ++a){
+			for(size_t b = 1; b < n; ++b){
+				const Particle& pa = particleRegistry[a];
+				const Particle& pb = particleRegistry[b];
+				bool match = (RuleSideMatches(r.typeOne, r.particleOne, pa) && RuleSideMatches(r.typeTwo, r.particleTwo, pb)) ||
+							 (RuleSideMatches(r.typeOne, r.particleOne, pb) && RuleSideMatches(r.typeTwo, r.particleTwo, pa));
+				if(match && spec >= specificity[a * n + b]){
+					specificity[a * n + b] = spec;
+					reactionTable[a * n + b] = result->second;
+				}
+			}
+		}
+	}
+}
+
+void ParticleWorld::InsertParticle(std::string typeName, Vector2 canvas)
+{
+	if(recorder)
+		recorder->InsertParticle(typeName, canvas);
+
+    int x = (int)canvas.x;
+    int y = (int)canvas.y;
+
+    if(x < 0 || x >= (int)width || y < 0 || y >= (int)height) 
+		return;
+
+	auto it = particleIDs.find(typeName);
+	if(it == particleIDs.end())
+		return;
+
+    cells[y * width + x].id = it->second;
+	ClearVelocity(CellRect{x, y, x + 1, y + 1});
+	MarkChanged(CellRect{x, y, x + 1, y + 1});
+}
+
+void ParticleWorld::InsertParticles(ParticleID id, const Vector2* positions, size_t count)
+{
+	if(recorder)
+		recorder->InsertParticles(id, positions, count);
+	if(id >= particleRegistry.size())
+		return;
+
+	for(size_t i = 0; i < count; ++i){
+		int x = (int)floorf(positions[i].x);
+		int y = (int)floorf(positions[i].y);
+		if(x < 0 || x >= (int)width || y < 0 || y >= (int)height)
+			continue;
+		cells[y * width + x].id = id;
+		ClearVelocity(CellRect{x, y, x + 1, y + 1});
+		MarkChanged(CellRect{x, y, x + 1, y + 1});
+	}
+}
+
+void ParticleWorld::FillRect(ParticleID id, Rectangle rect)
+{
+	if(recorder)
+		recorder->FillRect(id, rect);
+	if(id >= particleRegistry.size())
+		return;
+
+	CellRect r = CellRect{(int)floorf(rect.x), (int)floorf(rect.y),
+						  (int)ceilf(rect.x + rect.width), (int)ceilf(rect.y + rect.height)}
+				 .Intersect(CellRect{0, 0, (int)width, (int)height});
+	if(r.Empty())
+		return;
+
+	for(int y = r.y0; y < r.y1; ++y)
+		std::fill_n(cells.begin() + y*width + r.x0, r.x1 - r.x0, Cell{id});
+	ClearVelocity(r);
+	MarkChanged(r);
+}
+
+CellRect ParticleWorld::FillDisc(ParticleID id, int cx, int cy, float radius)
+{
+	int reach = (int)floorf(radius);
+	CellRect touched;
+	for(int dy = -reach; dy <= reach; ++dy){
+		int y = cy + dy;
+		if(y < 0 || y >= (int)height)
+			continue;
+		int half = (int)floorf(sqrtf(radius*radius - (float)(dy*dy)));
+		int x0 = std::max(cx - half, 0);
+		int x1 = std::min(cx + half + 1, (int)width);
+		if(x0 >= x1)
+			continue;
+		std::fill_n(cells.begin() + y*width + x0, x1 - x0, Cell{id});
+		ClearVelocity(CellRect{x0, y, x1, y + 1});
+		touched.Merge(CellRect{x0, y, x1, y + 1});
+	}
+	return touched;
+}
+
+void ParticleWorld::FillCircle(ParticleID id, Vector2 center, float radius)
+{
+	if(recorder)
+		recorder->FillCircle(id, center, radius);
+	if(id >= particleRegistry.size() || radius < 0.0f)
+		return;
+	MarkChanged(FillDisc(id, (int)floorf(center.x), (int)floorf(center.y), radius));
+}
+
+void ParticleWorld::FillLine(ParticleID id, Vector2 from, Vector2 to, float radius)
+{
+	if(recorder)
+		recorder->FillLine(id, from, to, radius);
+	if(id >= particleRegistry.size() || radius < 0.0f)
+		return;
+
+	// discs no further apart than half their radius leave no gaps, each
+	// one only wakes the chunks under it
+	float dx = to.x - from.x;
+	float dy = to.y - from.y;
+	float spacing = std::max(1.0f, radius * 0.5f);
+	int steps = (int)ceilf(sqrtf(dx*dx + dy*dy) / spacing);
+	for(int i = 0; i <= steps; ++i){
+		float t = steps > 0 ? (float)i / steps : 0.0f;
+		MarkChanged(FillDisc(id, (int)floorf(from.x + dx*t), (int)floorf(from.y + dy*t), radius));
+	}
+}
+
+void ParticleWorld::MarkChanged(const CellRect& rect)
+{
+	if(rect.Empty())
+		return;
+
+	// anything next to a changed cell may be able to move again
+	CellRect grid{0, 0, (int)width, (int)height};
+	CellRect wake = CellRect{rect.x0 - 1, rect.y0 - 1, rect.x1 + 1, rect.y1 + 1}.Intersect(grid);
+	if(wake.Empty())
+		return;
+
+	for(int cy = wake.y0 / CHUNK_SIZE; cy <= (wake.y1 - 1) / CHUNK_SIZE; ++cy){
+		for(int cx = wake.x0 / CHUNK_SIZE; cx <= (wake.x1 - 1) / CHUNK_SIZE; ++cx){
+			Chunk& chunk = chunks[cy * chunkCols + cx];
+			CellRect bounds{cx * CHUNK_SIZE, cy * CHUNK_SIZE, (cx + 1) * CHUNK_SIZE, (cy + 1) * CHUNK_SIZE};
+			chunk.awake = true;
+			chunk.heatIdle = false;
+			chunk.dirty.Merge(rect.Intersect(bounds).Intersect(grid));
+		}
+	}
+}
+
+void ParticleWorld::MarkAllDirty()
+{
+	for(size_t c = 0; c < chunks.size(); ++c)
+		chunks[c].dirty = ChunkBounds(c % chunkCols, c / chunkCols);
+}
+
+CellRect ParticleWorld::ChunkBounds(size_t cx, size_t cy) const
+{
+	int x0 = (int)cx * CHUNK_SIZE;
+	int y0 = (int)cy * CHUNK_SIZE;
+	return CellRect{x0, y0, std::min(x0 + CHUNK_SIZE, (int)width), std::min(y0 + CHUNK_SIZE, (int)height)};
+}
+
+// plane (x, y) takes old (x + dx, y + dy), whatever scrolls in is fill;
+// rows are walked so every source row is read before it gets overwritten
+template<typename T>
+static void ShiftPlane(std::vector<T>& plane, int w, int h, int dx, int dy, T fill)
+{
+	int keep = std::max(0, w - std::abs(dx));
+	for(int i = 0; i < h; ++i){
+		int y = dy >= 0 ? i : h - 1 - i;
+		T* row = plane.data() + (size_t)y * w;
+		int sy = y + dy;
+		if(sy < 0 || sy >= h || keep == 0){
+			std::fill_n(row, w, fill);
+			continue;
+		}
+		const T* src = plane.data() + (size_t)sy * w;
+		if(dx >= 0){
+			memmove(row, src + dx, keep * sizeof(T));
+			std::fill_n(row + keep, w - keep, fill);
+		}else{
+			memmove(row - dx, src, keep * sizeof(T));
+			std::fill_n(row, -dx, fill);
+		}
+	}
+}
+
+void ParticleWorld::ShiftWindow(int dcx, int dcy)
+{
+	if(dcx == 0 && dcy == 0)
+		return;
+	if(recorder)
+		recorder->ShiftWindow(dcx, dcy);
+	originChunkX += dcx;
+	originChunkY += dcy;
+
+	ShiftPlane(cells, (int)width, (int)height, dcx * CHUNK_SIZE, dcy * CHUNK_SIZE, Cell{});
+	if(!heat.empty()){
+		int step = CHUNK_SIZE >> heatShift;
+		ShiftPlane(heat, (int)heatWidth, (int)heatHeight, dcx * step, dcy * step, heatSettings.ambient);
+	}
+	if(!velocity.empty())
+		ShiftPlane(velocity, (int)width, (int)height, dcx * CHUNK_SIZE, dcy * CHUNK_SIZE, Velocity{});
+
+	std::fill(moveStamps.begin(), moveStamps.end(), 0);
+	MarkChanged(CellRect{0, 0, (int)width, (int)height});
+}
+
+int32_t ParticleWorld::GetOriginChunkX() const
+{
+	return originChunkX;
+}
+
+int32_t ParticleWorld::GetOriginChunkY() const
+{
+	return originChunkY;
+}
+
+Vector2 ParticleWorld::GetOrigin() const
+{
+	return Vector2{(float)originChunkX * CHUNK_SIZE, (float)originChunkY * CHUNK_SIZE};
+}
+
+size_t ParticleWorld::GetChunkCols() const
+{
+	return chunkCols;
+}
+
+size_t ParticleWorld::GetChunkRows() const
+{
+	return chunkRows;
+}
+
+void ParticleWorld::EncodeChunk(size_t cx, size_t cy, std::vector<uint8_t>& out) const
+{
+	if(cx >= chunkCols || cy >= chunkRows)
+		return;
+	EncodeCellsRLE(cells.data(), width, ChunkBounds(cx, cy), out);
+}
+
+bool ParticleWorld::DecodeChunk(size_t cx, size_t cy, const uint8_t* data, size_t size)
+{
+	if(cx >= chunkCols || cy >= chunkRows)
+		return false;
+	if(recorder)
+		recorder->DecodeChunk(cx, cy, data, size);
+
+	CellRect r = ChunkBounds(cx, cy);
+	bool ok = DecodeCellsRLE(data, size, cells.data(), width, r);
+	for(int y = r.y0; ok && y < r.y1; ++y)
+		for(int x = r.x0; x < r.x1; ++x)
+			if(cells[y*width + x].id >= particleRegistry.size()){
+				ok = false;
+				break;
+			}
+	if(!ok)
+		for(int y = r.y0; y < r.y1; ++y)
+			std::fill_n(cells.begin() + y*width + r.x0, r.x1 - r.x0, Cell{});
+	ClearVelocity(r);
+	MarkChanged(r);
+	return ok;
+}
+
+size_t ParticleWorld::ActiveChunkCount() const
+{
+	size_t n = 0;
+	for(const Chunk& chunk : chunks)
+		n += chunk.awake;
+	return n;
+}
+
+void ParticleWorld::SetThreadCount(size_t threads)
+{
+	if(threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	if(threads == GetThreadCount())
+		return;
+	pool.reset(threads > 1 ? new WorkerPool(threads) : nullptr);
+}
+
+size_t ParticleWorld::GetThreadCount() const
+{
+	return pool ? pool->Size() : 1;
+}
+
+void ParticleWorld::SetUpdateKernel(UPDATE_KERNEL kernel)
+{
+	if(recorder)
+		recorder->SetUpdateKernel(kernel);
+	this->kernel = kernel;
+}
+
+UPDATE_KERNEL ParticleWorld::GetUpdateKernel() const
+{
+	return kernel;
+}
+
+void ParticleWorld::SetSeed(uint64_t seed)
+{
+	if(recorder)
+		recorder->SetSeed(seed);
+	this->seed = seed;
+	frame = 0;
+	std::fill(moveStamps.begin(), moveStamps.end(), 0);
+}
+
+uint64_t ParticleWorld::GetSeed() const
+{
+	return seed;
+}
+
+uint64_t ParticleWorld::GetFrame() const
+{
+	return frame;
+}
+
+uint64_t ParticleWorld::GridHash() const
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for(const Cell& c : cells){
+		hash ^= c.id;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+void ParticleWorld::SetRecorder(ReplayRecorder* recorder)
+{
+	this->recorder = recorder;
+}
+
+void ParticleWorld::Update() {
+	PROFILE_SCOPE(ZONE_UPDATE);
+	++frame;
+
+	// moves onto a cell this frame has yet to visit (sideways, upwards,
+	// into another chunk, or several cells at once) stamp their target,
+	// so every particle moves at most once per frame
+	stampTag = (uint8_t)(frame % 255 + 1);
+	if(stampTag == 1)
+		std::fill(moveStamps.begin(), moveStamps.end(), 0);
+	for(Chunk& chunk : chunks){
+		chunk.running = chunk.awake;
+		chunk.awake = false;
+	}
+
+	for(int phase = 0; phase < 4; ++phase){
+		PROFILE_SCOPE(ZONE_UPDATE_PHASE);
+		scheduled.clear();
+		for(size_t c : phaseChunks[phase])
+			if(chunks[c].running)
+				scheduled.push_back(c);
+		PROFILE_COUNT(COUNTER_ACTIVE_CHUNKS, scheduled.size());
+
+		auto job = [&](size_t i){ UpdateChunk(scheduled[i]); };
+		if(pool)
+			pool->Run(scheduled.size(), job);
+		else
+			for(size_t i = 0; i < scheduled.size(); ++i)
+				job(i);
+
+		// chunks that settled stay asleep until something next to them changes
+		for(size_t c : scheduled){
+			Chunk& chunk = chunks[c];
+			if(chunk.restless)
+				chunk.awake = true;
+			MarkChanged(chunk.changed);
+			chunk.restless = false;
+			chunk.changed = CellRect{};
+			PROFILE_COUNT(COUNTER_CELLS_VISITED, chunk.visited);
+			PROFILE_COUNT(COUNTER_SWAPS, chunk.swaps);
+			PROFILE_COUNT(COUNTER_REACTIONS, chunk.reactions);
+			PROFILE_ONLY(chunk.visited = chunk.swaps = chunk.reactions = 0;)
+		}
+	}
+
+	if(!heat.empty() && frame % heatSettings.interval == 0)
+		UpdateHeat();
+
+	if(recorder)
+		recorder->Tick(*this);
+}
+
+void ParticleWorld::UpdateChunk(size_t chunk)
+{
+	// every chunk draws from its own stream, so the order workers pick
+	// chunks up in cannot change the result
+	SimRng rng(SplitMix64(seed ^ SplitMix64(frame)) ^ chunk);
+
+	int x0 = (int)(chunk % chunkCols) * CHUNK_SIZE;
+	int y0 = (int)(chunk / chunkCols) * CHUNK_SIZE;
+	UpdateRegion(x0, y0, std::min(x0 + CHUNK_SIZE, (int)width), std::min(y0 + CHUNK_SIZE, (int)height), rng, chunks[chunk]);
+}
+
+template<PARTICLE_TYPE T>
+void ParticleWorld::StepCell(int x, int y, ParticleID id, SimRng& rng, Chunk& out)
+{
+	typedef MoveRules<T> Rules;
+	const Particle& proto = particleRegistry[id];
+	int curr = y*width + x;
+
+	// falling types pick up speed and may cover several cells at once
+	Velocity v{};
+	if(FallsStraight<T>() && !velocity.empty()){
+		v = Accelerate(velocity[curr]);
+		if(Traverse(x, y, id, T == FLUID, v, rng, out))
+			return;
+	}
+
+	int flip = (Rules::mirror && (rng.Next() & 1)) ? -1 : 1;
+	for(const MoveStep& step : Rules::steps){
+		int nx = x + step.dx * flip;
+		int ny = y + step.dy;
+		if(nx < 0 || nx >= (int)width || ny < 0 || ny >= (int)height)
+			continue;
+		int next = ny*width + nx;
+		ParticleID other = cells[next].id;
+		// rows run bottom up, so only a move down within the chunk lands on
+		// a cell this frame is done with. sideways or up the rest of the row
+		// may still visit it, across a chunk edge a later phase may
+		bool stamp = step.dy <= 0 || nx / CHUNK_SIZE != x / CHUNK_SIZE || ny / CHUNK_SIZE != y / CHUNK_SIZE;
+
+		if(other == EMPTY_PARTICLE){
+			if(!step.gated || rng.NextFloat() < proto.density){
+				std::swap(cells[curr], cells[next]);
+				PROFILE_ONLY(++out.swaps;)
+				if(stamp)
+					moveStamps[next] = stampTag;
+				// only a step down keeps the fall going
+				if(!velocity.empty()){
+					velocity[next] = step.dy > 0 ? v : Velocity{v.x, 0};
+					velocity[curr] = Velocity{};
+				}
+				out.changed.Add(x, y);
+				out.changed.Add(nx, ny);
+				return;
+			}
+			out.restless = true;
+			break;
+		}
+
+		ParticleID result = ReactionResult(id, other);
+		if(result != EMPTY_PARTICLE){
+			cells[next].id = result;
+			cells[curr].id = EMPTY_PARTICLE;
+			if(stamp)
+				moveStamps[next] = stampTag;
+			if(!velocity.empty())
+				velocity[next] = velocity[curr] = Velocity{};
+			PROFILE_ONLY(++out.reactions;)
+			out.changed.Add(x, y);
+			out.changed.Add(nx, ny);
+			return;
+		}
+
+		const Particle& target = particleRegistry[other];
+		if(target.type == FLUID || target.type == GAS){
+			// heavier sinks below lighter, lighter rises above heavier
+			float sink = step.dy < 0 ? target.density - proto.density : proto.density - target.density;
+			if(sink > 0.0f){
+				if(rng.NextFloat() < sink){
+					std::swap(cells[curr], cells[next]);
+					PROFILE_ONLY(++out.swaps;)
+					if(stamp)
+						moveStamps[next] = stampTag;
+					if(!velocity.empty())
+						velocity[next] = velocity[curr] = Velocity{};
+					out.changed.Add(x, y);
+					out.changed.Add(nx, ny);
+					return;
+				}
+				out.restless = true;
+			}
+		}
+	}
+
+	// did not move, so it is at rest
+	if(!velocity.empty() && (velocity[curr].x | velocity[curr].y))
+		velocity[curr] = Velocity{};
+}
+
+void ParticleWorld::FallRow(int x0, int x1, int y, bool leavesChunk, Chunk& out)
+{
+	Cell* row = &cells[y*width + x0];
+	Cell* below = &cells[(y+1)*width + x0];
+	uint8_t* stamps = &moveStamps[y*width + x0];
+	uint8_t* stampsBelow = &moveStamps[(y+1)*width + x0];
+	uint64_t mask = FallCandidates(row, below, x1 - x0);
+
+	int first = -1, last = -1;
+	while(mask){
+		int i = __builtin_ctzll(mask);
+		mask &= mask - 1;
+		if(!fallsStraight[row[i].id] || stamps[i] == stampTag)
+			continue;
+		below[i] = row[i];
+		row[i].id = EMPTY_PARTICLE;
+		if(leavesChunk)
+			stampsBelow[i] = stampTag;
+		PROFILE_ONLY(++out.swaps;)
+		if(first < 0) first = i;
+		last = i;
+	}
+	if(first >= 0){
+		out.changed.Add(x0 + first, y);
+		out.changed.Add(x0 + last, y + 1);
+	}
+}
+
+void ParticleWorld::UpdateRegion(int x0, int y0, int x1, int y1, SimRng& rng, Chunk& out) {
+	int regionWidth = x1 - x0;
+	uint8_t cols[CHUNK_SIZE];
+	for(int i = 0; i < regionWidth; ++i)
+		cols[i] = (uint8_t)i;
+
+    for(int y = y1-1; y >= y0; --y){
+		// plain falls into empty cells are the common case, do them a
+		// whole row segment at a time before the per-cell rules
+		if(kernel == KERNEL_SIMD && velocity.empty() && y + 1 < (int)height)
+			FallRow(x0, x1, y, y + 1 == y1, out);
+
+		// visit columns in a fresh random order every row (Fisher-Yates,
+		// two 16 bit draws per Next()), so no sideways direction is favoured
+		for(int i = regionWidth - 1; i > 0; i -= 2){
+			uint32_t r = rng.Next();
+			std::swap(cols[i], cols[((r & 0xFFFF) * (uint32_t)(i + 1)) >> 16]);
+			if(i > 1)
+				std::swap(cols[i - 1], cols[((r >> 16) * (uint32_t)i) >> 16]);
+		}
+
+        for(int xi = 0; xi < regionWidth; ++xi){
+			int x = x0 + cols[xi];
+			int curr = y*width + x;
+
+            ParticleID id = cells[curr].id;
+			// empty, or already moved here this frame
+			if(id == EMPTY_PARTICLE || moveStamps[curr] == stampTag)
+				continue;
+			PROFILE_ONLY(++out.visited;)
+
+			switch(particleRegistry[id].type){
+				case SOLID:
+					StepCell<SOLID>(x, y, id, rng, out);
+					break;
+				case FLUID:
+					StepCell<FLUID>(x, y, id, rng, out);
+					break;
+				case GAS:
+					StepCell<GAS>(x, y, id, rng, out);
+					break;
+				default:
+					break;
+			}
+        }
+    }
+}
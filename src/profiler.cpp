@@ -0,0 +1,145 @@
+#include "profiler.h"
+#include "alloc_counter.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+uint64_t Profiler::AllocationCount()
+{
+#ifdef PHYSSIM_PROFILE
+	return CountedAllocations();
+#else
+	return 0;
+#endif
+}
+
+Profiler::Profiler()
+{
+	epoch = std::chrono::steady_clock::now();
+	frames.assign(PROFILE_HISTORY, ProfileFrame{});
+	events.assign(PROFILE_MAX_EVENTS, Event{});
+	frameCount = 0;
+	eventCount = 0;
+	allocationsAtFrameStart = AllocationCount();
+}
+
+Profiler& Profiler::Get()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+const char* Profiler::ZoneName(PROFILE_ZONE zone)
+{
+	switch(zone){
+		case ZONE_UPDATE:          return "Update";
+		case ZONE_UPDATE_PHASE:    return "UpdatePhase";
+		case ZONE_HEAT:            return "Heat";
+		case ZONE_PUBLISH:         return "PublishFrame";
+		case ZONE_UPDATE_COLORS:   return "UpdateColors";
+		case ZONE_UPDATE_TEXTURES: return "UpdateTextures";
+		case ZONE_DRAW:            return "Draw";
+		case ZONE_DEBUG_TEXT:      return "DebugText";
+		default:                   return "?";
+	}
+}
+
+const char* Profiler::CounterName(PROFILE_COUNTER counter)
+{
+	switch(counter){
+		case COUNTER_CELLS_VISITED: return "cells_visited";
+		case COUNTER_SWAPS:         return "swaps";
+		case COUNTER_REACTIONS:     return "reactions";
+		case COUNTER_ALLOCATIONS:   return "allocations";
+		case COUNTER_ACTIVE_CHUNKS: return "active_chunks";
+		default:                    return "?";
+	}
+}
+
+int64_t Profiler::NowUs() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::NextFrame()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	uint64_t allocated = AllocationCount();
+	ProfileFrame& done = frames[frameCount % PROFILE_HISTORY];
+	done.counters[COUNTER_ALLOCATIONS] = allocated - allocationsAtFrameStart;
+	allocationsAtFrameStart = allocated;
+
+	++frameCount;
+	ProfileFrame& next = frames[frameCount % PROFILE_HISTORY];
+	next = ProfileFrame{};
+	next.index = frameCount;
+	next.startUs = NowUs();
+}
+
+void Profiler::AddZone(PROFILE_ZONE zone, int64_t startUs, int64_t endUs)
+{
+	// small stable ids make for readable trace rows
+	static std::atomic<int> threads{0};
+	thread_local int thread = ++threads;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	frames[frameCount % PROFILE_HISTORY].zoneMs[zone] += (endUs - startUs) / 1000.0;
+	events[eventCount % PROFILE_MAX_EVENTS] = Event{zone, thread, startUs, endUs - startUs};
+	++eventCount;
+}
+
+void Profiler::Count(PROFILE_COUNTER counter, uint64_t n)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	frames[frameCount % PROFILE_HISTORY].counters[counter] += n;
+}
+
+const ProfileFrame& Profiler::CurrentFrame() const
+{
+	return frames[frameCount % PROFILE_HISTORY];
+}
+
+const ProfileFrame& Profiler::LastFrame() const
+{
+	return History(0);
+}
+
+const ProfileFrame& Profiler::History(size_t back) const
+{
+	if(back >= HistorySize())
+		return frames[frameCount % PROFILE_HISTORY];
+	return frames[(frameCount - 1 - back) % PROFILE_HISTORY];
+}
+
+size_t Profiler::HistorySize() const
+{
+	return (size_t)std::min<uint64_t>(frameCount, PROFILE_HISTORY - 1);
+}
+
+bool Profiler::WriteChromeTrace(const std::string& path) const
+{
+	FILE* f = fopen(path.c_str(), "w");
+	if(!f)
+		return false;
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	bool first = true;
+	size_t begin = eventCount > PROFILE_MAX_EVENTS ? eventCount - PROFILE_MAX_EVENTS : 0;
+	for(size_t i = begin; i < eventCount; ++i){
+		const Event& e = events[i % PROFILE_MAX_EVENTS];
+		fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%d}",
+				first ? "" : ",\n", ZoneName(e.zone), (long long)e.startUs, (long long)e.durationUs, e.thread);
+		first = false;
+	}
+	for(size_t back = HistorySize(); back-- > 0; ){
+		const ProfileFrame& frame = History(back);
+		fprintf(f, "%s{\"name\":\"counters\",\"ph\":\"C\",\"ts\":%lld,\"pid\":1,\"args\":{",
+				first ? "" : ",\n", (long long)frame.startUs);
+		for(int c = 0; c < COUNTER_COUNT; ++c)
+			fprintf(f, "%s\"%s\":%llu", c ? "," : "", CounterName((PROFILE_COUNTER)c), (unsigned long long)frame.counters[c]);
+		fprintf(f, "}}");
+		first = false;
+	}
+	fprintf(f, "\n]}\n");
+	return fclose(f) == 0;
+}
@@ -0,0 +1,63 @@
+// headless lockstep replayer, one JSON object per log on stdout:
+//   replay session.rpl [more.rpl ...] [--threads N]
+// runs every log written with `exec --record` as fast as it can and checks
+// each checkpoint hash; exits 1 if any log diverges or cannot be read.
+// the update kernel is part of the log, the thread count is not since it
+// must not change the result.
+#include "particle_world.h"
+#include "replay_log.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> logs;
+	size_t threads = 1;
+	for(int i = 1; i < argc; ++i){
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : "";
+		if(!strcmp(arg, "--threads"))     { threads = (size_t)atoi(value); ++i; }
+		else if(arg[0] == '-'){
+			fprintf(stderr, "unknown option %s\n", arg);
+			return 1;
+		}
+		else logs.push_back(arg);
+	}
+	if(logs.empty()){
+		fprintf(stderr, "usage: replay session.rpl [more.rpl ...] [--threads N]\n");
+		return 1;
+	}
+
+	int status = 0;
+	for(const std::string& log : logs){
+		size_t width, height;
+		if(!ReadReplaySize(log, width, height)){
+			fprintf(stderr, "could not read %s\n", log.c_str());
+			status = 1;
+			continue;
+		}
+
+		ParticleWorld world(width, height);
+		world.SetThreadCount(threads);
+
+		ReplayResult result;
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		bool ok = RunReplay(log, world, result);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		if(!ok || result.mismatches > 0)
+			status = 1;
+
+		printf("{\"log\":\"%s\",\"width\":%zu,\"height\":%zu,\"threads\":%zu,\"complete\":%s,\"ticks\":%llu,"
+			   "\"checkpoints\":%llu,\"mismatches\":%llu,\"first_mismatch\":%llu,\"seconds\":%.4f,\"update_cells_per_sec\":%.1f}\n",
+			   log.c_str(), width, height, world.GetThreadCount(), ok ? "true" : "false",
+			   (unsigned long long)result.ticks, (unsigned long long)result.checkpoints,
+			   (unsigned long long)result.mismatches, (unsigned long long)result.firstMismatch,
+			   seconds, seconds > 0 ? (double)width * height * result.ticks / seconds : 0.0);
+		fflush(stdout);
+	}
+	return status;
+}
@@ -0,0 +1,524 @@
+#include "replay_log.h"
+#include "byte_io.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+// log layout, all fields native (little) endian:
+//
+//   ReplayHeader
+//   records     one REPLAY_OP byte each, then its payload; runs of
+//               Update() calls are a single REPLAY_TICKS record
+//
+// fields are encoded as in byte_io.h.
+
+#define REPLAY_MAGIC "PHYSRPL1"
+#define REPLAY_VERSION 1
+// the recorder writes to disk once this much has piled up
+#define REPLAY_FLUSH_BYTES (64 * 1024)
+
+struct ReplayHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t checkpointInterval;
+	uint64_t width, height;
+	uint64_t seed;
+};
+
+enum REPLAY_OP : uint8_t {
+	REPLAY_TICKS = 1,      // u32 count
+	REPLAY_CHECKPOINT,     // u64 frame, u64 grid hash
+	REPLAY_REGISTER,       // str name, u32 type, 4 colour bytes, f32 density
+	REPLAY_INTERACTION,    // u32 typeOne, str particleOne, u32 typeTwo, str particleTwo, str result
+	REPLAY_INSERT,         // str name, f32 x, f32 y
+	REPLAY_INSERT_BATCH,   // u8 id, u32 count, count * (f32 x, f32 y)
+	REPLAY_FILL_RECT,      // u8 id, f32 x, y, width, height
+	REPLAY_FILL_CIRCLE,    // u8 id, f32 x, y, radius
+	REPLAY_FILL_LINE,      // u8 id, f32 fromX, fromY, toX, toY, radius
+	REPLAY_SEED,           // u64 seed
+	REPLAY_KERNEL,         // u32 kernel
+	REPLAY_SHIFT,          // i32 dcx, i32 dcy
+	REPLAY_CHUNK,          // u32 cx, u32 cy, u32 size, runs
+	REPLAY_SNAPSHOT,       // u64 size, the snapshot file
+	REPLAY_HEAT,           // u8 enabled, then if enabled i32 resolution, i32 interval, f32 diffusion, ambient, cooling, coupling
+	REPLAY_THERMAL,        // u32 kind, str particle, f32 temperature, str result
+	REPLAY_VELOCITY,       // u8 enabled, then if enabled f32 gravity, maxSpeed, splash, drag
+};
+
+ReplayRecorder::ReplayRecorder()
+{
+	file = nullptr;
+	pendingTicks = 0;
+	checkpointInterval = 0;
+}
+
+ReplayRecorder::~ReplayRecorder()
+{
+	Close();
+}
+
+bool ReplayRecorder::Open(const std::string& path, const ParticleWorld& world, uint32_t checkpointInterval)
+{
+	Close();
+	file = fopen(path.c_str(), "wb");
+	if(!file)
+		return false;
+
+	this->checkpointInterval = checkpointInterval;
+	pendingTicks = 0;
+	buffer.clear();
+
+	ReplayHeader header = {};
+	memcpy(header.magic, REPLAY_MAGIC, 8);
+	header.version = REPLAY_VERSION;
+	header.checkpointInterval = checkpointInterval;
+	header.width = world.GetWidth();
+	header.height = world.GetHeight();
+	header.seed = world.GetSeed();
+	PutBytes(buffer, &header, sizeof(header));
+	return true;
+}
+
+bool ReplayRecorder::Close()
+{
+	if(!file)
+		return false;
+	FlushTicks();
+	Flush();
+	bool ok = fclose(file) == 0;
+	file = nullptr;
+	return ok;
+}
+
+bool ReplayRecorder::IsOpen() const
+{
+	return file != nullptr;
+}
+
+void ReplayRecorder::FlushTicks()
+{
+	if(pendingTicks == 0)
+		return;
+	buffer.push_back(REPLAY_TICKS);
+	PutU32(buffer, pendingTicks);
+	pendingTicks = 0;
+}
+
+void ReplayRecorder::Flush()
+{
+	if(file && !buffer.empty())
+		fwrite(buffer.data(), 1, buffer.size(), file);
+	buffer.clear();
+}
+
+void ReplayRecorder::RegisterParticle(const Particle& prototype)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_REGISTER);
+	PutStr(buffer, prototype.parent);
+	PutU32(buffer, (uint32_t)prototype.type);
+	PutBytes(buffer, &prototype.clr, 4);
+	PutF32(buffer, prototype.density);
+}
+
+void ReplayRecorder::AddInteractionRule(const InteractionRule& rule)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_INTERACTION);
+	PutU32(buffer, (uint32_t)rule.typeOne);
+	PutStr(buffer, rule.particleOne);
+	PutU32(buffer, (uint32_t)rule.typeTwo);
+	PutStr(buffer, rule.particleTwo);
+	PutStr(buffer, rule.result);
+}
+
+void ReplayRecorder::InsertParticle(const std::string& typeName, Vector2 pos)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_INSERT);
+	PutStr(buffer, typeName);
+	PutF32(buffer, pos.x);
+	PutF32(buffer, pos.y);
+}
+
+void ReplayRecorder::InsertParticles(ParticleID id, const Vector2* positions, size_t count)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_INSERT_BATCH);
+	buffer.push_back(id);
+	PutU32(buffer, (uint32_t)count);
+	for(size_t i = 0; i < count; ++i){
+		PutF32(buffer, positions[i].x);
+		PutF32(buffer, positions[i].y);
+	}
+}
+
+void ReplayRecorder::FillRect(ParticleID id, Rectangle rect)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_FILL_RECT);
+	buffer.push_back(id);
+	PutF32(buffer, rect.x);
+	PutF32(buffer, rect.y);
+	PutF32(buffer, rect.width);
+	PutF32(buffer, rect.height);
+}
+
+void ReplayRecorder::FillCircle(ParticleID id, Vector2 center, float radius)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_FILL_CIRCLE);
+	buffer.push_back(id);
+	PutF32(buffer, center.x);
+	PutF32(buffer, center.y);
+	PutF32(buffer, radius);
+}
+
+void ReplayRecorder::FillLine(ParticleID id, Vector2 from, Vector2 to, float radius)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_FILL_LINE);
+	buffer.push_back(id);
+	PutF32(buffer, from.x);
+	PutF32(buffer, from.y);
+	PutF32(buffer, to.x);
+	PutF32(buffer, to.y);
+	PutF32(buffer, radius);
+}
+
+void ReplayRecorder::SetSeed(uint64_t seed)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_SEED);
+	PutU64(buffer, seed);
+}
+
+void ReplayRecorder::SetUpdateKernel(UPDATE_KERNEL kernel)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_KERNEL);
+	PutU32(buffer, (uint32_t)kernel);
+}
+
+void ReplayRecorder::ShiftWindow(int dcx, int dcy)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_SHIFT);
+	PutU32(buffer, (uint32_t)dcx);
+	PutU32(buffer, (uint32_t)dcy);
+}
+
+void ReplayRecorder::DecodeChunk(size_t cx, size_t cy, const uint8_t* data, size_t size)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_CHUNK);
+	PutU32(buffer, (uint32_t)cx);
+	PutU32(buffer, (uint32_t)cy);
+	PutU32(buffer, (uint32_t)size);
+	PutBytes(buffer, data, size);
+}
+
+void ReplayRecorder::LoadSnapshot(const std::string& path)
+{
+	// the file may be gone or rewritten by the time the log is replayed
+	std::ifstream in(path, std::ios::binary);
+	std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	FlushTicks();
+	buffer.push_back(REPLAY_SNAPSHOT);
+	PutU64(buffer, bytes.size());
+	PutBytes(buffer, bytes.data(), bytes.size());
+	Flush();
+}
+
+void ReplayRecorder::EnableHeat(const HeatSettings& settings)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_HEAT);
+	buffer.push_back(1);
+	PutU32(buffer, (uint32_t)settings.resolution);
+	PutU32(buffer, (uint32_t)settings.interval);
+	PutF32(buffer, settings.diffusion);
+	PutF32(buffer, settings.ambient);
+	PutF32(buffer, settings.cooling);
+	PutF32(buffer, settings.coupling);
+}
+
+void ReplayRecorder::DisableHeat()
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_HEAT);
+	buffer.push_back(0);
+}
+
+void ReplayRecorder::EnableVelocity(const VelocitySettings& settings)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_VELOCITY);
+	buffer.push_back(1);
+	PutF32(buffer, settings.gravity);
+	PutF32(buffer, settings.maxSpeed);
+	PutF32(buffer, settings.splash);
+	PutF32(buffer, settings.drag);
+}
+
+void ReplayRecorder::DisableVelocity()
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_VELOCITY);
+	buffer.push_back(0);
+}
+
+void ReplayRecorder::AddThermalRule(const ThermalRule& rule)
+{
+	FlushTicks();
+	buffer.push_back(REPLAY_THERMAL);
+	PutU32(buffer, (uint32_t)rule.kind);
+	PutStr(buffer, rule.particle);
+	PutF32(buffer, rule.temperature);
+	PutStr(buffer, rule.result);
+}
+
+void ReplayRecorder::Tick(const ParticleWorld& world)
+{
+	++pendingTicks;
+	if(checkpointInterval > 0 && world.GetFrame() % checkpointInterval == 0){
+		FlushTicks();
+		buffer.push_back(REPLAY_CHECKPOINT);
+		PutU64(buffer, world.GetFrame());
+		PutU64(buffer, world.GridHash());
+	}
+	if(buffer.size() >= REPLAY_FLUSH_BYTES)
+		Flush();
+}
+
+static bool ReadLog(const std::string& path, std::vector<uint8_t>& bytes, ReplayHeader& header)
+{
+	std::ifstream in(path, std::ios::binary);
+	if(!in)
+		return false;
+	bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	if(bytes.size() < sizeof(header))
+		return false;
+	memcpy(&header, bytes.data(), sizeof(header));
+	return memcmp(header.magic, REPLAY_MAGIC, 8) == 0 && header.version == REPLAY_VERSION;
+}
+
+bool ReadReplaySize(const std::string& path, size_t& width, size_t& height)
+{
+	std::vector<uint8_t> bytes;
+	ReplayHeader header;
+	if(!ReadLog(path, bytes, header))
+		return false;
+	width = (size_t)header.width;
+	height = (size_t)header.height;
+	return true;
+}
+
+bool RunReplay(const std::string& path, ParticleWorld& world, ReplayResult& result)
+{
+	std::vector<uint8_t> bytes;
+	ReplayHeader header;
+	if(!ReadLog(path, bytes, header) || header.width != world.GetWidth() || header.height != world.GetHeight())
+		return false;
+
+	result = ReplayResult{};
+	world.SetSeed(header.seed);
+
+	ByteReader in{bytes.data() + sizeof(header), bytes.data() + bytes.size()};
+	std::vector<Vector2> positions;
+	while(in.ok && in.p < in.end){
+		switch(in.U8()){
+			case REPLAY_TICKS: {
+				uint32_t n = in.U32();
+				for(uint32_t i = 0; i < n; ++i)
+					world.Update();
+				result.ticks += n;
+				break;
+			}
+			case REPLAY_CHECKPOINT: {
+				uint64_t frame = in.U64();
+				uint64_t hash = in.U64();
+				++result.checkpoints;
+				if(frame != world.GetFrame() || hash != world.GridHash()){
+					if(result.mismatches++ == 0)
+						result.firstMismatch = frame;
+				}
+				break;
+			}
+			case REPLAY_REGISTER: {
+				Particle p;
+				p.parent = in.Str();
+				uint32_t type = in.U32();
+				// out of range enums mean a corrupt log, as in LoadSnapshot()
+				if(type > GAS){
+					in.ok = false;
+					break;
+				}
+				p.type = (PARTICLE_TYPE)type;
+				in.Read(&p.clr, 4);
+				p.density = in.F32();
+				world.RegisterParticle(p);
+				break;
+			}
+			case REPLAY_INTERACTION: {
+				uint32_t rawOne = in.U32();
+				std::string particleOne = in.Str();
+				uint32_t rawTwo = in.U32();
+				std::string particleTwo = in.Str();
+				std::string resultName = in.Str();
+				if(rawOne > GAS || rawTwo > GAS){
+					in.ok = false;
+					break;
+				}
+				PARTICLE_TYPE typeOne = (PARTICLE_TYPE)rawOne;
+				PARTICLE_TYPE typeTwo = (PARTICLE_TYPE)rawTwo;
+				if(typeOne != NONE && typeTwo != NONE)
+					world.InteractionTypeToType(typeOne, typeTwo, resultName);
+				else if(typeOne != NONE)
+					world.InteractionTypeToParticle(typeOne, particleTwo, resultName);
+				else
+					world.SetParticleInteraction(particleOne, particleTwo, resultName);
+				break;
+			}
+			case REPLAY_INSERT: {
+				std::string name = in.Str();
+				float x = in.F32();
+				float y = in.F32();
+				world.InsertParticle(name, Vector2{x, y});
+				break;
+			}
+			case REPLAY_INSERT_BATCH: {
+				ParticleID id = in.U8();
+				uint32_t n = in.U32();
+				if((size_t)(in.end - in.p) / 8 < n){
+					in.ok = false;
+					break;
+				}
+				positions.resize(n);
+				for(uint32_t i = 0; i < n; ++i){
+					positions[i].x = in.F32();
+					positions[i].y = in.F32();
+				}
+				world.InsertParticles(id, positions.data(), n);
+				break;
+			}
+			case REPLAY_FILL_RECT: {
+				ParticleID id = in.U8();
+				Rectangle r;
+				r.x = in.F32(); r.y = in.F32(); r.width = in.F32(); r.height = in.F32();
+				world.FillRect(id, r);
+				break;
+			}
+			case REPLAY_FILL_CIRCLE: {
+				ParticleID id = in.U8();
+				Vector2 c;
+				c.x = in.F32(); c.y = in.F32();
+				world.FillCircle(id, c, in.F32());
+				break;
+			}
+			case REPLAY_FILL_LINE: {
+				ParticleID id = in.U8();
+				Vector2 from, to;
+				from.x = in.F32(); from.y = in.F32();
+				to.x = in.F32(); to.y = in.F32();
+				world.FillLine(id, from, to, in.F32());
+				break;
+			}
+			case REPLAY_SEED:
+				world.SetSeed(in.U64());
+				break;
+			case REPLAY_KERNEL: {
+				uint32_t kernel = in.U32();
+				if(kernel > KERNEL_SIMD){
+					in.ok = false;
+					break;
+				}
+				world.SetUpdateKernel((UPDATE_KERNEL)kernel);
+				break;
+			}
+			case REPLAY_SHIFT: {
+				int dcx = (int)in.U32();
+				int dcy = (int)in.U32();
+				world.ShiftWindow(dcx, dcy);
+				break;
+			}
+			case REPLAY_CHUNK: {
+				uint32_t cx = in.U32();
+				uint32_t cy = in.U32();
+				uint32_t size = in.U32();
+				const uint8_t* runs = in.Bytes(size);
+				if(runs)
+					world.DecodeChunk(cx, cy, runs, size);
+				break;
+			}
+			case REPLAY_SNAPSHOT: {
+				// LoadSnapshot() wants a file, so the embedded one goes back to disk
+				uint64_t size = in.U64();
+				const uint8_t* snapshot = in.Bytes((size_t)size);
+				if(!snapshot)
+					break;
+				std::string temp = path + ".snap";
+				FILE* f = fopen(temp.c_str(), "wb");
+				if(!f)
+					return false;
+				bool written = fwrite(snapshot, 1, (size_t)size, f) == size;
+				written = fclose(f) == 0 && written;
+				bool loaded = written && world.LoadSnapshot(temp);
+				remove(temp.c_str());
+				if(!loaded)
+					return false;
+				break;
+			}
+			case REPLAY_HEAT: {
+				if(!in.U8()){
+					world.DisableHeat();
+					break;
+				}
+				HeatSettings settings;
+				settings.resolution = (int)in.U32();
+				settings.interval = (int)in.U32();
+				settings.diffusion = in.F32();
+				settings.ambient = in.F32();
+				settings.cooling = in.F32();
+				settings.coupling = in.F32();
+				world.EnableHeat(settings);
+				break;
+			}
+			case REPLAY_THERMAL: {
+				uint32_t kind = in.U32();
+				std::string particle = in.Str();
+				float temperature = in.F32();
+				std::string resultName = in.Str();
+				if(kind > THERMAL_BELOW){
+					in.ok = false;
+					break;
+				}
+				if(kind == THERMAL_SOURCE)
+					world.SetParticleTemperature(particle, temperature);
+				else if(kind == THERMAL_ABOVE)
+					world.SetPhaseChangeAbove(particle, temperature, resultName);
+				else
+					world.SetPhaseChangeBelow(particle, temperature, resultName);
+				break;
+			}
+			case REPLAY_VELOCITY: {
+				if(!in.U8()){
+					world.DisableVelocity();
+					break;
+				}
+				VelocitySettings settings;
+				settings.gravity = in.F32();
+				settings.maxSpeed = in.F32();
+				settings.splash = in.F32();
+				settings.drag = in.F32();
+				world.EnableVelocity(settings);
+				break;
+			}
+			default:
+				in.ok = false;
+				break;
+		}
+	}
+	return in.ok;
+}
@@ -0,0 +1,44 @@
+#include "sim_clock.h"
+#include <algorithm>
+#include <cmath>
+
+SimulationClock::SimulationClock(double stepsPerSecond, int maxStepsPerFrame)
+{
+	this->maxStepsPerFrame = std::max(1, maxStepsPerFrame);
+	stepSeconds = 1.0 / stepsPerSecond;
+	accumulator = 0.0;
+	droppedSteps = 0;
+}
+
+int SimulationClock::Advance(double elapsedSeconds)
+{
+	accumulator += std::max(0.0, elapsedSeconds);
+	int steps = (int)std::min(floor(accumulator / stepSeconds), (double)INT32_MAX);
+	accumulator -= steps * stepSeconds;
+	if(steps > maxStepsPerFrame){
+		droppedSteps += steps - maxStepsPerFrame;
+		steps = maxStepsPerFrame;
+	}
+	return steps;
+}
+
+void SimulationClock::SetRate(double stepsPerSecond)
+{
+	stepSeconds = 1.0 / stepsPerSecond;
+	accumulator = std::min(accumulator, stepSeconds);
+}
+
+double SimulationClock::GetStepSeconds() const
+{
+	return stepSeconds;
+}
+
+double SimulationClock::GetAlpha() const
+{
+	return accumulator / stepSeconds;
+}
+
+uint64_t SimulationClock::GetDroppedSteps() const
+{
+	return droppedSteps;
+}
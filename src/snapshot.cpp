@@ -0,0 +1,304 @@
+#include "particle_world.h"
+#include "chunk_codec.h"
+#include "replay_log.h"
+#include "byte_io.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// snapshot layout, all fields native (little) endian:
+//
+//   SnapshotHeader
+//   metadata    registry, interaction rules, compiled reaction table
+//   grid        at a SNAPSHOT_ALIGN boundary, either the raw ID plane
+//               (width * height bytes, row-major) or, with SNAPSHOT_RLE,
+//               a table of (offset, size) per chunk followed by each
+//               chunk's EncodeCellsRLE runs
+//
+// the raw plane is copied straight out of the mapping on load.
+
+#define SNAPSHOT_MAGIC "PHYSSNP1"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_RLE 1u
+#define SNAPSHOT_ALIGN 4096
+
+struct SnapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t width, height;
+	uint64_t seed, frame;
+	uint64_t metaOffset, metaSize;
+	uint64_t gridOffset, gridSize;
+};
+
+struct ChunkEntry {
+	uint64_t offset, size;
+};
+
+class MappedFile {
+public:
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+
+	bool Open(const std::string& path);
+	~MappedFile();
+private:
+#ifdef _WIN32
+	std::vector<uint8_t> buffer;
+#else
+	void* mapping = nullptr;
+#endif
+};
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	if(!in)
+		return false;
+	buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	data = buffer.data();
+	size = buffer.size();
+	return true;
+}
+
+MappedFile::~MappedFile(){
+}
+#else
+bool MappedFile::Open(const std::string& path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0){
+		close(fd);
+		return false;
+	}
+	void* m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(m == MAP_FAILED)
+		return false;
+	mapping = m;
+	data = (const uint8_t*)m;
+	size = (size_t)st.st_size;
+	return true;
+}
+
+MappedFile::~MappedFile(){
+	if(mapping)
+		munmap(mapping, size);
+}
+#endif
+
+static uint64_t AlignUp(uint64_t v)
+{
+	return (v + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+bool ParticleWorld::SaveSnapshot(const std::string& path, bool compress)
+{
+	std::vector<uint8_t> meta;
+	PutU32(meta, (uint32_t)particleRegistry.size());
+	for(const Particle& p : particleRegistry){
+		PutStr(meta, p.parent);
+		PutU32(meta, (uint32_t)p.type);
+		PutBytes(meta, &p.clr, 4);
+		PutBytes(meta, &p.density, 4);
+	}
+	PutU32(meta, (uint32_t)interactionRules.size());
+	for(const InteractionRule& r : interactionRules){
+		PutU32(meta, (uint32_t)r.typeOne);
+		PutStr(meta, r.particleOne);
+		PutU32(meta, (uint32_t)r.typeTwo);
+		PutStr(meta, r.particleTwo);
+		PutStr(meta, r.result);
+	}
+	PutU32(meta, (uint32_t)reactionStride);
+	PutBytes(meta, reactionTable.data(), reactionTable.size());
+
+	std::vector<uint8_t> packed;
+	if(compress){
+		std::vector<ChunkEntry> table(chunks.size());
+		std::vector<uint8_t> runs;
+		for(size_t c = 0; c < chunks.size(); ++c){
+			int x0 = (int)(c % chunkCols) * CHUNK_SIZE;
+			int y0 = (int)(c / chunkCols) * CHUNK_SIZE;
+			CellRect rect{x0, y0, std::min(x0 + CHUNK_SIZE, (int)width), std::min(y0 + CHUNK_SIZE, (int)height)};
+			table[c].offset = sizeof(uint64_t) + table.size() * sizeof(ChunkEntry) + runs.size();
+			EncodeCellsRLE(cells.data(), width, rect, runs);
+			table[c].size = sizeof(uint64_t) + table.size() * sizeof(ChunkEntry) + runs.size() - table[c].offset;
+		}
+		uint64_t count = table.size();
+		PutBytes(packed, &count, sizeof(count));
+		PutBytes(packed, table.data(), table.size() * sizeof(ChunkEntry));
+		PutBytes(packed, runs.data(), runs.size());
+	}
+
+	SnapshotHeader header;
+	memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+	header.version = SNAPSHOT_VERSION;
+	header.flags = compress ? SNAPSHOT_RLE : 0;
+	header.width = width;
+	header.height = height;
+	header.seed = seed;
+	header.frame = frame;
+	header.metaOffset = sizeof(SnapshotHeader);
+	header.metaSize = meta.size();
+	header.gridOffset = AlignUp(header.metaOffset + header.metaSize);
+	header.gridSize = compress ? packed.size() : cells.size() * sizeof(Cell);
+
+	FILE* f = fopen(path.c_str(), "wb");
+	if(!f)
+		return false;
+	static const uint8_t zeros[SNAPSHOT_ALIGN] = {};
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+			  fwrite(meta.data(), 1, meta.size(), f) == meta.size() &&
+			  fwrite(zeros, 1, header.gridOffset - header.metaOffset - header.metaSize, f) == header.gridOffset - header.metaOffset - header.metaSize;
+	if(ok && compress)
+		ok = fwrite(packed.data(), 1, packed.size(), f) == packed.size();
+	else if(ok)
+		ok = fwrite(cells.data(), sizeof(Cell), cells.size(), f) == cells.size();
+	ok = fclose(f) == 0 && ok;
+	return ok;
+}
+
+static bool ReadHeader(const MappedFile& file, SnapshotHeader& header)
+{
+	if(file.size < sizeof(SnapshotHeader))
+		return false;
+	memcpy(&header, file.data, sizeof(header));
+	return memcmp(header.magic, SNAPSHOT_MAGIC, 8) == 0 &&
+		   header.version == SNAPSHOT_VERSION &&
+		   header.metaOffset <= file.size && header.metaSize <= file.size - header.metaOffset &&
+		   header.gridOffset <= file.size && header.gridSize <= file.size - header.gridOffset;
+}
+
+bool ParticleWorld::ReadSnapshotSize(const std::string& path, size_t& width, size_t& height)
+{
+	MappedFile file;
+	SnapshotHeader header;
+	if(!file.Open(path) || !ReadHeader(file, header))
+		return false;
+	width = (size_t)header.width;
+	height = (size_t)header.height;
+	return true;
+}
+
+bool ParticleWorld::LoadSnapshot(const std::string& path)
+{
+	MappedFile file;
+	SnapshotHeader header;
+	if(!file.Open(path) || !ReadHeader(file, header))
+		return false;
+	if(header.width != width || header.height != height)
+		return false;
+
+	// parse everything before touching the world, a bad file changes nothing
+	ByteReader meta{file.data + header.metaOffset, file.data + header.metaOffset + header.metaSize};
+	uint32_t typeCount = meta.U32();
+	if(typeCount == 0 || typeCount > MAX_PARTICLE_TYPES)
+		return false;
+	std::vector<Particle> registry(typeCount);
+	std::unordered_set<std::string> names;
+	for(size_t id = 0; id < registry.size(); ++id){
+		Particle& p = registry[id];
+		p.parent = meta.Str();
+		uint32_t type = meta.U32();
+		meta.Read(&p.clr, 4);
+		meta.Read(&p.density, 4);
+		if(!meta.ok || type > GAS)
+			return false;
+		p.type = (PARTICLE_TYPE)type;
+		// slot 0 is the empty cell, every other slot a uniquely named type
+		if(id == 0 ? (p.type != NONE || !p.parent.empty()) : (p.parent.empty() || !names.insert(p.parent).second))
+			return false;
+	}
+	uint32_t ruleCount = meta.U32();
+	std::vector<InteractionRule> rules;
+	for(uint32_t i = 0; i < ruleCount && meta.ok; ++i){
+		InteractionRule r;
+		uint32_t typeOne = meta.U32();
+		r.particleOne = meta.Str();
+		uint32_t typeTwo = meta.U32();
+		r.particleTwo = meta.Str();
+		r.result = meta.Str();
+		if(typeOne > GAS || typeTwo > GAS)
+			return false;
+		r.typeOne = (PARTICLE_TYPE)typeOne;
+		r.typeTwo = (PARTICLE_TYPE)typeTwo;
+		rules.push_back(r);
+	}
+	uint32_t stride = meta.U32();
+	if(!meta.ok || stride != typeCount)
+		return false;
+	std::vector<ParticleID> table((size_t)stride * stride);
+	meta.Read(table.data(), table.size());
+	if(!meta.ok)
+		return false;
+	for(ParticleID id : table)
+		if(id >= typeCount)
+			return false;
+
+	const uint8_t* grid = file.data + header.gridOffset;
+	std::vector<Cell> loaded(width * height);
+	if(header.flags & SNAPSHOT_RLE){
+		uint64_t count = 0;
+		if(header.gridSize < sizeof(count))
+			return false;
+		memcpy(&count, grid, sizeof(count));
+		if(count != chunks.size() || header.gridSize < sizeof(count) + count * sizeof(ChunkEntry))
+			return false;
+		for(size_t c = 0; c < count; ++c){
+			ChunkEntry entry;
+			memcpy(&entry, grid + sizeof(count) + c * sizeof(ChunkEntry), sizeof(entry));
+			if(entry.offset > header.gridSize || entry.size > header.gridSize - entry.offset)
+				return false;
+			int x0 = (int)(c % chunkCols) * CHUNK_SIZE;
+			int y0 = (int)(c / chunkCols) * CHUNK_SIZE;
+			CellRect rect{x0, y0, std::min(x0 + CHUNK_SIZE, (int)width), std::min(y0 + CHUNK_SIZE, (int)height)};
+			if(!DecodeCellsRLE(grid + entry.offset, entry.size, loaded.data(), width, rect))
+				return false;
+		}
+	}else{
+		if(header.gridSize != loaded.size() * sizeof(Cell))
+			return false;
+		memcpy(loaded.data(), grid, header.gridSize);
+	}
+	const uint8_t* ids = (const uint8_t*)loaded.data();
+	if(!loaded.empty() && *std::max_element(ids, ids + loaded.size()) >= typeCount)
+		return false;
+
+	cells.swap(loaded);
+	particleRegistry.swap(registry);
+	particleIDs.clear();
+	for(size_t id = 1; id < particleRegistry.size(); ++id)
+		particleIDs[particleRegistry[id].parent] = (ParticleID)id;
+	interactionRules.swap(rules);
+	reactionTable.swap(table);
+	reactionStride = stride;
+	CompileMoveTables();
+	CompileHeatTables();
+	// neither the heat field nor velocities are part of a snapshot
+	std::fill(heat.begin(), heat.end(), heatSettings.ambient);
+	seed = header.seed;
+	frame = header.frame;
+	std::fill(moveStamps.begin(), moveStamps.end(), 0);
+	std::fill(velocity.begin(), velocity.end(), Velocity{});
+
+	MarkChanged(CellRect{0, 0, (int)width, (int)height});
+	if(recorder)
+		recorder->LoadSnapshot(path);
+	return true;
+}
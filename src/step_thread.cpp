@@ -0,0 +1,55 @@
+#include "step_thread.h"
+
+StepThread::StepThread(ParticleWorld& world)
+	: world(world)
+{
+	pendingSteps = 0;
+	stopping = false;
+	thread = std::thread(&StepThread::ThreadLoop, this);
+}
+
+StepThread::~StepThread()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	thread.join();
+}
+
+void StepThread::Start(int steps)
+{
+	if(steps <= 0)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingSteps += steps;
+	}
+	wake.notify_all();
+}
+
+void StepThread::Wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&]{ return pendingSteps == 0; });
+}
+
+void StepThread::ThreadLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for(;;){
+		wake.wait(lock, [&]{ return stopping || pendingSteps > 0; });
+		if(stopping)
+			return;
+
+		int steps = pendingSteps;
+		lock.unlock();
+		for(int i = 0; i < steps; ++i)
+			world.Update();
+		lock.lock();
+		pendingSteps -= steps;
+		if(pendingSteps == 0)
+			done.notify_all();
+	}
+}
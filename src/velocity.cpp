@@ -0,0 +1,161 @@
+#include "particle_world.h"
+#include "replay_log.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// velocity is a side plane of int8 fixed point pairs next to the grid. it
+// is only read for SOLID and FLUID cells: every step they pick up gravity,
+// and once that adds up to two cells or more per step StepCell hands them
+// to Traverse(), which walks a Bresenham line and stops in front of the
+// first occupied cell. slower cells go through the one-cell move rules as
+// before and carry their velocity along.
+
+void ParticleWorld::EnableVelocity(const VelocitySettings& settings)
+{
+	if(recorder)
+		recorder->EnableVelocity(settings);
+
+	// a move of up to CHUNK_SIZE / 2 - 1 cells out of a chunk cannot reach
+	// anything the other chunks of its phase touch
+	int cap = std::min(CHUNK_SIZE / 2 - 1, 127 >> VELOCITY_SHIFT);
+	velocitySettings = settings;
+	velocitySettings.maxSpeed = std::min(std::max(settings.maxSpeed, 1.0f), (float)cap);
+	velocitySettings.gravity = std::max(settings.gravity, 0.0f);
+	velocitySettings.splash = std::min(std::max(settings.splash, 0.0f), 1.0f);
+	velocitySettings.drag = std::max(settings.drag, 0.0f);
+
+	speedCap = (int)(velocitySettings.maxSpeed * VELOCITY_ONE);
+	gravityStep = std::min((int)lroundf(velocitySettings.gravity * VELOCITY_ONE), speedCap);
+	dragStep = std::min((int)lroundf(velocitySettings.drag * VELOCITY_ONE), speedCap);
+	splashShare = (int)lroundf(velocitySettings.splash * 256.0f);
+	velocity.assign(width * height, Velocity{});
+}
+
+void ParticleWorld::DisableVelocity()
+{
+	if(recorder)
+		recorder->DisableVelocity();
+	std::vector<Velocity>().swap(velocity);
+}
+
+bool ParticleWorld::VelocityEnabled() const
+{
+	return !velocity.empty();
+}
+
+const VelocitySettings& ParticleWorld::GetVelocitySettings() const
+{
+	return velocitySettings;
+}
+
+Vector2 ParticleWorld::GetVelocity(Vector2 canvas) const
+{
+	int x = (int)floorf(canvas.x);
+	int y = (int)floorf(canvas.y);
+	if(velocity.empty() || x < 0 || x >= (int)width || y < 0 || y >= (int)height)
+		return Vector2{0, 0};
+	Velocity v = velocity[y * width + x];
+	return Vector2{(float)v.x / VELOCITY_ONE, (float)v.y / VELOCITY_ONE};
+}
+
+void ParticleWorld::ClearVelocity(const CellRect& rect)
+{
+	if(velocity.empty() || rect.Empty())
+		return;
+	for(int y = rect.y0; y < rect.y1; ++y)
+		std::fill_n(velocity.begin() + y*width + rect.x0, rect.x1 - rect.x0, Velocity{});
+}
+
+Velocity ParticleWorld::Accelerate(Velocity v) const
+{
+	int vx = v.x > 0 ? std::max(v.x - dragStep, 0) : std::min(v.x + dragStep, 0);
+	int vy = std::min(v.y + gravityStep, speedCap);
+	return Velocity{(int8_t)vx, (int8_t)vy};
+}
+
+// whole cells covered this step; the fraction decides at random, so a
+// speed of 2.25 moves 3 cells one step in four
+static int CellsThisStep(int v, uint32_t r)
+{
+	int cells = (std::abs(v) + (int)(r & (VELOCITY_ONE - 1))) >> VELOCITY_SHIFT;
+	return v < 0 ? -cells : cells;
+}
+
+bool ParticleWorld::Traverse(int x, int y, ParticleID id, bool fluid, Velocity& v, SimRng& rng, Chunk& out)
+{
+	// up to one cell per step is what the move rules do anyway, which is
+	// where most cells are, so they get away without a random draw
+	if(std::abs(v.x) <= VELOCITY_ONE && std::abs(v.y) <= VELOCITY_ONE)
+		return false;
+
+	uint32_t r = rng.Next();
+	int dx = CellsThisStep(v.x, r);
+	int dy = CellsThisStep(v.y, r >> 8);
+	int ax = std::abs(dx), ay = std::abs(dy);
+	if(std::max(ax, ay) < 2)
+		return false;
+
+	int curr = y*width + x;
+	int sx = dx < 0 ? -1 : 1, sy = dy < 0 ? -1 : 1;
+	int err = ax - ay;
+	int px = x, py = y;
+	bool blockedX = false, blockedY = false;
+	for(int i = std::max(ax, ay); i > 0; --i){
+		int e2 = 2 * err;
+		int nx = px, ny = py;
+		if(e2 > -ay){ err -= ay; nx += sx; }
+		if(e2 < ax){ err += ax; ny += sy; }
+
+		ParticleID other = EMPTY_PARTICLE;
+		bool inside = nx >= 0 && nx < (int)width && ny >= 0 && ny < (int)height;
+		if(inside)
+			other = cells[ny*width + nx].id;
+		if(inside && other == EMPTY_PARTICLE){
+			px = nx;
+			py = ny;
+			continue;
+		}
+
+		// hitting something it reacts with ends the trip right there
+		ParticleID result = inside ? ReactionResult(id, other) : EMPTY_PARTICLE;
+		if(result != EMPTY_PARTICLE){
+			int next = ny*width + nx;
+			cells[next].id = result;
+			cells[curr].id = EMPTY_PARTICLE;
+			velocity[next] = velocity[curr] = Velocity{};
+			moveStamps[next] = stampTag;
+			PROFILE_ONLY(++out.reactions;)
+			out.changed.Add(x, y);
+			out.changed.Add(nx, ny);
+			return true;
+		}
+		blockedX = nx != px;
+		blockedY = ny != py;
+		break;
+	}
+
+	if(blockedX)
+		v.x = 0;
+	if(blockedY){
+		// a landing fluid keeps part of its fall as sideways speed
+		if(fluid && v.x == 0)
+			v.x = (int8_t)(((r >> 16) & 1 ? 1 : -1) * ((v.y * splashShare) >> 8));
+		v.y = 0;
+	}
+	// stopped before the first cell, the move rules get the new velocity
+	if(px == x && py == y)
+		return false;
+
+	int dest = py*width + px;
+	cells[dest] = cells[curr];
+	cells[curr].id = EMPTY_PARTICLE;
+	velocity[dest] = v;
+	velocity[curr] = Velocity{};
+	// it may have landed on a cell this pass has not reached yet
+	moveStamps[dest] = stampTag;
+	PROFILE_ONLY(++out.swaps;)
+	out.changed.Add(x, y);
+	out.changed.Add(px, py);
+	return true;
+}
@@ -0,0 +1,69 @@
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(size_t threadCount) {
+	for(size_t i = 1; i < threadCount; ++i)
+		workers.emplace_back(&WorkerPool::WorkerLoop, this);
+}
+
+WorkerPool::~WorkerPool(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(std::thread& t : workers)
+		t.join();
+}
+
+void WorkerPool::Drain()
+{
+	for(size_t i = nextJob.fetch_add(1); i < jobCount; i = nextJob.fetch_add(1))
+		jobFn(jobCtx, i);
+}
+
+void WorkerPool::RunJobs(size_t count, JobFn fn, void* ctx)
+{
+	if(workers.empty() || count <= 1){
+		for(size_t i = 0; i < count; ++i)
+			fn(ctx, i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobFn = fn;
+		jobCtx = ctx;
+		jobCount = count;
+		nextJob.store(0);
+		busy = workers.size();
+		++generation;
+	}
+	wake.notify_all();
+
+	Drain();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&]{ return busy == 0; });
+	jobFn = nullptr;
+	jobCtx = nullptr;
+}
+
+void WorkerPool::WorkerLoop()
+{
+	size_t seen = 0;
+	for(;;){
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]{ return stopping || generation != seen; });
+			if(stopping)
+				return;
+			seen = generation;
+		}
+
+		Drain();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if(--busy == 0)
+			done.notify_one();
+	}
+}
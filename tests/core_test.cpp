@@ -0,0 +1,329 @@
+// headless checks of the simulation core, run by ctest. exits non-zero
+// and names the failing case on stderr if anything is off.
+//   core_test
+// steps every bench scene the ways bench can run it and expects no
+// operator new calls over the second half of the steps (the build links
+// in alloc_counter.cpp to count them), then locks in the guarantees the
+// rest of the core makes: one move per particle per Update(), the same
+// grid for any thread count, reaction precedence, snapshot and replay
+// round trips, chunk streaming, and Pool handles. files go to the
+// working directory and are removed again.
+#include "particle_world.h"
+#include "alloc_counter.h"
+#include "bench_scenes.h"
+#include "chunk_streamer.h"
+#include "pool.h"
+#include "replay_log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#define TEST_SIZE 256
+#define TEST_STEPS 200
+
+static int failures = 0;
+
+static void Check(bool ok, const char* what)
+{
+	if(ok)
+		return;
+	fprintf(stderr, "FAIL %s\n", what);
+	++failures;
+}
+
+struct SceneVariant {
+	const char* name;
+	UPDATE_KERNEL kernel;
+	int heat;
+	bool velocity;
+};
+
+static const SceneVariant variants[] = {
+	{ "scalar", KERNEL_SCALAR, 0, false },
+	{ "simd", KERNEL_SIMD, 0, false },
+	{ "heat", KERNEL_SCALAR, 4, false },
+	{ "velocity", KERNEL_SCALAR, 0, true },
+};
+
+static void BuildVariant(ParticleWorld& world, int scene, const SceneVariant& variant, size_t threads)
+{
+	world.SetSeed(1);
+	world.SetThreadCount(threads);
+	world.SetUpdateKernel(variant.kernel);
+	RegisterScenePalette(world, variant.heat);
+	if(variant.velocity)
+		world.EnableVelocity(VelocitySettings{});
+	BuildScene(world, scene, 1);
+}
+
+static std::string ReadFile(const std::string& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(const std::string& path, const std::string& bytes)
+{
+	std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+}
+
+static void TestSteadyAllocations()
+{
+	for(int scene = 0; scene < SCENE_COUNT; ++scene)
+	for(const SceneVariant& variant : variants)
+	for(size_t threads : { 1, 4 }){
+		ParticleWorld world(TEST_SIZE, TEST_SIZE);
+		BuildVariant(world, scene, variant, threads);
+
+		uint64_t allocationsAtHalf = 0;
+		for(int step = 0; step < TEST_STEPS; ++step){
+			if(step == TEST_STEPS / 2)
+				allocationsAtHalf = CountedAllocations();
+			world.Update();
+		}
+		uint64_t allocations = CountedAllocations() - allocationsAtHalf;
+		if(allocations != 0)
+			fprintf(stderr, "FAIL %s %s threads %zu: %llu allocations in steady state\n",
+					sceneNames[scene], variant.name, threads, (unsigned long long)allocations);
+		failures += allocations != 0;
+	}
+}
+
+// a lone fluid cell resting on a floor may step one cell sideways per
+// Update() and no further, wherever it sits relative to the chunk edges
+static void TestSingleStep()
+{
+	int worst = 0;
+	for(uint64_t seed = 1; seed <= 500; ++seed){
+		ParticleWorld world(2 * CHUNK_SIZE, CHUNK_SIZE);
+		world.RegisterParticle(GenSolidParticle("STONE", GRAY, 0.6f));
+		world.RegisterParticle(GenFluidParticle("WATER", BLUE, 0.1f));
+		ParticleID water = world.GetParticleID("WATER");
+		world.SetSeed(seed);
+		world.SetUpdateKernel(seed % 2 ? KERNEL_SCALAR : KERNEL_SIMD);
+		int floor = CHUNK_SIZE / 2;
+		int startX = CHUNK_SIZE / 2 + (int)(seed % CHUNK_SIZE);
+		world.FillRect(world.GetParticleID("STONE"), Rectangle{0, (float)floor, 2 * CHUNK_SIZE, (float)(CHUNK_SIZE - floor)});
+		world.FillRect(water, Rectangle{(float)startX, (float)(floor - 1), 1, 1});
+		world.Update();
+
+		const Cell* cells = world.GetCells();
+		for(int i = 0; i < 2 * CHUNK_SIZE * floor; ++i)
+			if(cells[i].id == water)
+				worst = std::max(worst, std::abs(i % (2 * CHUNK_SIZE) - startX) + std::abs(i / (2 * CHUNK_SIZE) - (floor - 1)));
+	}
+	Check(worst <= 1, "a particle moves at most one cell per Update()");
+}
+
+// chunks draw from their own streams, so the thread count cannot change
+// the result
+static void TestThreadDeterminism()
+{
+	for(int scene : { SCENE_WATER_LAVA, SCENE_CHURN, SCENE_RAIN })
+	for(const SceneVariant& variant : variants){
+		uint64_t hashes[3];
+		size_t threadCounts[3] = { 1, 4, 7 };
+		for(int i = 0; i < 3; ++i){
+			ParticleWorld world(TEST_SIZE, TEST_SIZE);
+			BuildVariant(world, scene, variant, threadCounts[i]);
+			for(int step = 0; step < TEST_STEPS / 2; ++step)
+				world.Update();
+			hashes[i] = world.GridHash();
+		}
+		if(hashes[0] != hashes[1] || hashes[0] != hashes[2])
+			fprintf(stderr, "FAIL %s %s differs between 1, 4 and 7 threads\n", sceneNames[scene], variant.name);
+		failures += hashes[0] != hashes[1] || hashes[0] != hashes[2];
+	}
+}
+
+// the more specific rule wins whatever order they were set in: particle
+// to particle, then type to particle, then type to type
+static void TestReactionPrecedence()
+{
+	for(int rules = 1; rules <= 3; ++rules){
+		ParticleWorld world(8, 8);
+		world.RegisterParticle(GenParticle("WALL", STATIC, GRAY, 1.0f));
+		world.RegisterParticle(GenSolidParticle("SAND", BEIGE, 0.2f));
+		world.RegisterParticle(GenFluidParticle("WATER", BLUE, 0.1f));
+		world.RegisterParticle(GenParticle("BY_TYPES", STATIC, RED, 1.0f));
+		world.RegisterParticle(GenParticle("BY_TYPE_AND_NAME", STATIC, GREEN, 1.0f));
+		world.RegisterParticle(GenParticle("BY_NAMES", STATIC, BLUE, 1.0f));
+		if(rules >= 3)
+			world.SetParticleInteraction("SAND", "WATER", "BY_NAMES");
+		if(rules >= 2)
+			world.InteractionTypeToParticle(SOLID, "WATER", "BY_TYPE_AND_NAME");
+		world.InteractionTypeToType(SOLID, FLUID, "BY_TYPES");
+
+		// water held in a one cell pocket, sand falling onto it
+		ParticleID wall = world.GetParticleID("WALL");
+		world.FillRect(wall, Rectangle{0, 5, 8, 3});
+		world.FillRect(wall, Rectangle{3, 4, 1, 1});
+		world.FillRect(wall, Rectangle{5, 4, 1, 1});
+		world.FillRect(world.GetParticleID("WATER"), Rectangle{4, 4, 1, 1});
+		world.FillRect(world.GetParticleID("SAND"), Rectangle{4, 3, 1, 1});
+		world.Update();
+
+		const char* expected = rules == 3 ? "BY_NAMES" : rules == 2 ? "BY_TYPE_AND_NAME" : "BY_TYPES";
+		ParticleID got = world.GetCells()[4 * 8 + 4].id;
+		if(got != world.GetParticleID(expected))
+			fprintf(stderr, "FAIL reaction with %d rule(s) gave id %d, not %s\n", rules, (int)got, expected);
+		failures += got != world.GetParticleID(expected);
+	}
+}
+
+static void TestSnapshots()
+{
+	for(bool compress : { false, true }){
+		const char* path = compress ? "core_test_rle.snap" : "core_test_raw.snap";
+		ParticleWorld world(TEST_SIZE, TEST_SIZE);
+		BuildVariant(world, SCENE_WATER_LAVA, variants[0], 1);
+		for(int step = 0; step < 20; ++step)
+			world.Update();
+		Check(world.SaveSnapshot(path, compress), "snapshot saves");
+
+		// a loaded snapshot carries seed and frame, so it also steps the same
+		ParticleWorld loaded(TEST_SIZE, TEST_SIZE);
+		Check(loaded.LoadSnapshot(path), "snapshot loads");
+		Check(loaded.GridHash() == world.GridHash(), "snapshot restores the grid");
+		for(int step = 0; step < 20; ++step){
+			world.Update();
+			loaded.Update();
+		}
+		Check(loaded.GridHash() == world.GridHash(), "a loaded snapshot steps like the original");
+		remove(path);
+	}
+
+	// a registry LoadSnapshot() has to turn down
+	const char* path = "core_test_bad.snap";
+	ParticleWorld world(64, 64);
+	world.RegisterParticle(GenSolidParticle("AAAA", BEIGE, 0.2f));
+	world.RegisterParticle(GenFluidParticle("BBBB", BLUE, 0.1f));
+	world.FillRect(world.GetParticleID("AAAA"), Rectangle{0, 0, 10, 10});
+	world.SaveSnapshot(path, false);
+	std::string good = ReadFile(path);
+	size_t a = good.find("AAAA"), b = good.find("BBBB");
+
+	std::string truncated = good.substr(0, good.size() / 2);
+	std::string badMagic = good;
+	badMagic[0] = 'X';
+	std::string badType = good;
+	badType[a + 4] = 9; // the u32 type after the name
+	std::string duplicate = good;
+	memcpy(&duplicate[b], "AAAA", 4);
+
+	const std::string* bad[] = { &truncated, &badMagic, &badType, &duplicate };
+	for(const std::string* bytes : bad){
+		WriteFile(path, *bytes);
+		ParticleWorld fresh(64, 64);
+		Check(!fresh.LoadSnapshot(path), "a malformed snapshot is rejected");
+	}
+	WriteFile(path, good);
+	ParticleWorld fresh(64, 64);
+	Check(fresh.LoadSnapshot(path), "the untouched snapshot still loads");
+	remove(path);
+}
+
+static void TestReplay()
+{
+	const char* path = "core_test.rpl";
+	{
+		ReplayRecorder recorder;
+		ParticleWorld world(TEST_SIZE, TEST_SIZE);
+		Check(recorder.Open(path, world, 10), "replay log opens");
+		world.SetRecorder(&recorder);
+		BuildVariant(world, SCENE_WATER_LAVA, variants[2], 4);
+		for(int step = 0; step < 100; ++step){
+			if(step == 50)
+				world.FillCircle(world.GetParticleID("SAND"), Vector2{100, 20}, 6);
+			world.Update();
+		}
+		world.SetRecorder(nullptr);
+		Check(recorder.Close(), "replay log closes");
+	}
+
+	ParticleWorld world(TEST_SIZE, TEST_SIZE);
+	ReplayResult result;
+	Check(RunReplay(path, world, result), "replay log reads back");
+	Check(result.ticks == 100 && result.checkpoints == 10, "replay runs every tick and checkpoint");
+	Check(result.mismatches == 0, "replay hits every checkpoint");
+	remove(path);
+}
+
+// chunks scrolled out and back in, through memory and through disk,
+// come back exactly as they left
+static void TestStreaming()
+{
+	ParticleWorld world(3 * CHUNK_SIZE, 3 * CHUNK_SIZE);
+	RegisterScenePalette(world, 0);
+	BuildScene(world, SCENE_SETTLED, 1);
+	for(int step = 0; step < 50; ++step)
+		world.Update();
+	uint64_t before = world.GridHash();
+
+	for(size_t cacheLimit : { 64, 1 }){
+		ChunkStreamer streamer(world, "core_test_pages", cacheLimit);
+		Check(streamer.MoveTo(2, 1) && streamer.MoveTo(-5, 7), "window moves");
+		Check(streamer.StoredChunkCount() > 0, "scrolled out chunks are stored");
+		Check(streamer.MoveTo(0, 0), "window moves back");
+		Check(world.GridHash() == before, "streaming out and back in restores the grid");
+		Check(streamer.StoredChunkCount() == 0, "chunks back in the window are no longer stored");
+	}
+	std::error_code ec;
+	std::filesystem::remove_all("core_test_pages", ec);
+}
+
+static void TestPool()
+{
+	Pool<std::vector<int>> pool;
+	PoolHandle first = pool.Acquire();
+	PoolHandle second = pool.Acquire();
+	Check(pool.Valid(first) && pool.Valid(second), "fresh handles are valid");
+	Check(first.index != second.index, "fresh handles get their own slots");
+	Check(pool.Size() == 2 && pool.Capacity() == 2, "size and capacity after two acquires");
+	Check(!pool.Valid(PoolHandle{}) && pool.Get(PoolHandle{}) == nullptr, "default handle is invalid");
+
+	pool.Get(first)->assign(1000, 7);
+	const int* buffer = pool.Get(first)->data();
+	pool.Release(first);
+	Check(!pool.Valid(first) && pool.Get(first) == nullptr, "released handle goes stale");
+	Check(pool.Size() == 1 && pool.Capacity() == 2, "release keeps the slot");
+	pool.Release(first);
+	Check(pool.Size() == 1, "releasing a stale handle does nothing");
+
+	PoolHandle reused = pool.Acquire();
+	Check(reused.index == first.index && reused.generation != first.generation, "acquire reuses the released slot");
+	Check(!pool.Valid(first), "old handle stays stale after reuse");
+	Check(pool.Get(reused) && pool.Get(reused)->capacity() >= 1000 && pool.Get(reused)->data() == buffer,
+		  "reused object keeps its buffer");
+	Check(pool.Size() == 2 && pool.Capacity() == 2, "reuse does not grow the pool");
+
+	// steady state churn costs nothing once the slots exist
+	uint64_t before = CountedAllocations();
+	for(int i = 0; i < 100; ++i){
+		pool.Release(reused);
+		reused = pool.Acquire();
+		pool.Get(reused)->assign(1000, i);
+	}
+	Check(CountedAllocations() == before, "acquire and release of warm slots allocate nothing");
+}
+
+int main()
+{
+	TestSteadyAllocations();
+	TestSingleStep();
+	TestThreadDeterminism();
+	TestReactionPrecedence();
+	TestSnapshots();
+	TestReplay();
+	TestStreaming();
+	TestPool();
+	if(failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}